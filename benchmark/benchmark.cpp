@@ -0,0 +1,514 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef HAVE_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "binarylog.hpp"
+#include "cmdline.hpp"
+#include "cmdlineapp.hpp"
+#include "cmdlinebatch.hpp"
+#include "numberlist.hpp"
+#include "console.hpp"
+#include "consoleformat.hpp"
+#include "consolelimit.hpp"
+#include "consolesink.hpp"
+#include "ketopt.h"
+
+
+typedef std::chrono::steady_clock benchClock;
+
+static double elapsedNs (benchClock::time_point start, unsigned iterations)
+{
+    std::chrono::duration<double, std::nano> d = benchClock::now () - start;
+    return d.count () / iterations;
+}
+
+// generates 'count' long options "--option-<n>" and registers them in 'cmdline'
+static void addOptions (cCmdline& cmdline, unsigned count, std::vector<std::string>& names, std::vector<int>& isSet)
+{
+    names.resize (count);
+    isSet.resize (count);
+    for (unsigned n = 0; n < count; n++)
+    {
+        names[n] = "option-" + std::to_string (n);
+        cmdline.addOption (true, 0, names[n].c_str (), "benchmark option", &isSet[n]);
+    }
+}
+
+// per-call cost of cCmdline::parse depending on the number of registered options
+static void benchParse ()
+{
+    const unsigned optionCounts[] = {10, 100, 1000};
+
+    std::printf ("%-28s %10s %14s %14s\n", "parse", "options", "first [ns]", "repeated [ns]");
+    for (unsigned count : optionCounts)
+    {
+        cCmdline cmdline;
+        std::vector<std::string> names;
+        std::vector<int> isSet;
+        addOptions (cmdline, count, names, isSet);
+
+        std::string arg1 = "--" + names[0];
+        std::string arg2 = "--" + names[count / 2];
+        std::string arg3 = "--" + names[count - 1];
+        char* argv[] = {(char*)"bench", &arg1[0], &arg2[0], &arg3[0]};
+
+        benchClock::time_point start = benchClock::now ();
+        cmdline.parse (4, argv);
+        double first = elapsedNs (start, 1);
+
+        const unsigned iterations = 10000;
+        start = benchClock::now ();
+        for (unsigned n = 0; n < iterations; n++)
+            cmdline.parse (4, argv);
+        double repeated = elapsedNs (start, iterations);
+
+        std::printf ("%-28s %10u %14.0f %14.0f\n", "", count, first, repeated);
+    }
+}
+
+// cost of permuting argv when options are mixed with a huge number of non-option arguments
+static void benchPermute ()
+{
+    const unsigned argcs[] = {10, 100, 1000, 10000, 100000, 1000000};
+    // ketopt's own permutation is quadratic, don't wait for it forever
+    const unsigned maxKetoptArgc = 100000;
+    const ko_longopt_t longopts[] = {{NULL, 0, 0}};
+
+    std::printf ("%-28s %10s %14s %14s\n", "permute", "argc", "cCmdline [ms]", "ketopt [ms]");
+    for (unsigned argc : argcs)
+    {
+        // every second argument is an option: file -a file -a ...
+        std::vector<char*> argv (argc);
+        argv[0] = (char*)"bench";
+        for (unsigned n = 1; n < argc; n++)
+            argv[n] = (char*)(n & 1 ? "file" : "-a");
+
+        int isSet;
+        cCmdline cmdline;
+        cmdline.addOption (true, 'a', nullptr, "benchmark option", &isSet);
+
+        std::vector<char*> work (argv);
+        benchClock::time_point start = benchClock::now ();
+        cmdline.parse ((int)argc, work.data ());
+        double ours = elapsedNs (start, 1) / 1e6;
+
+        if (argc <= maxKetoptArgc)
+        {
+            work = argv;
+            ketopt_t s = KETOPT_INIT;
+            start = benchClock::now ();
+            while (ketopt (&s, (int)argc, work.data (), 1, "a", longopts, NULL, NULL) >= 0)
+            {
+            }
+            std::printf ("%-28s %10u %14.3f %14.3f\n", "", argc, ours, elapsedNs (start, 1) / 1e6);
+        }
+        else
+        {
+            std::printf ("%-28s %10u %14.3f %14s\n", "", argc, ours, "-");
+        }
+    }
+}
+
+// throughput of cCmdlineBatch depending on the number of threads
+static void benchBatch ()
+{
+    const unsigned lines = 2000000;
+
+    cCmdline cmdline;
+    std::vector<std::string> names;
+    std::vector<int> isSet;
+    addOptions (cmdline, 20, names, isSet);
+
+    // every 10th line has an unknown option
+    std::string text;
+    for (unsigned n = 0; n < lines; n++)
+    {
+        text += "job --" + names[n % 20] + " --" + names[(n + 7) % 20] + " input-" + std::to_string (n);
+        text += n % 10 ? " output\n" : " --unknown\n";
+    }
+
+    std::printf ("%-28s %10s %14s %14s\n", "batch", "threads", "[ms]", "[Mlines/s]");
+    unsigned cores = std::thread::hardware_concurrency ();
+    for (unsigned threads = 1; ; threads *= 2)
+    {
+        if (threads > cores)
+            threads = cores ? cores : 1;
+
+        // the text is split in place, so every run gets a fresh copy
+        std::string work = text;
+        cCmdlineBatch batch (cmdline);
+        benchClock::time_point start = benchClock::now ();
+        batch.validate (&work[0], work.size (), threads);
+        double ms = elapsedNs (start, 1) / 1e6;
+        std::printf ("%-28s %10u %14.1f %14.2f\n", "", threads, ms, lines / ms / 1e3);
+
+        if (threads >= cores)
+            break;
+    }
+}
+
+// throughput of the number list scanner per implementation
+static void benchNumberList ()
+{
+    const unsigned count = 1000000;
+    const unsigned iterations = 20;
+    const cNumberList::implementation impls[] = {cNumberList::SCALAR, cNumberList::SSE2, cNumberList::AVX2};
+    const char* names[] = {"scalar", "sse2", "avx2"};
+
+    // ids with 1 to 10 digits and cpu ranges
+    std::string ids, cpus;
+    unsigned x = 4711;
+    for (unsigned n = 0; n < count; n++)
+    {
+        x = x * 1103515245 + 12345;
+        ids += (n ? "," : "") + std::to_string (x >> (x % 28));
+        cpus += (n ? "," : "") + std::to_string (n * 16 % 1000000) + "-" + std::to_string (n * 16 % 1000000 + 7);
+    }
+    std::vector<uint64_t> out (cNumberList::capacity (cpus.size (), true));
+
+    std::printf ("%-28s %10s %14s %14s\n", "number list", "", "list [GB/s]", "ranges [GB/s]");
+    for (size_t k = 0; k < sizeof (impls) / sizeof (impls[0]); k++)
+    {
+        if (!cNumberList::available (impls[k]))
+            continue;
+        size_t values;
+        benchClock::time_point start = benchClock::now ();
+        for (unsigned n = 0; n < iterations; n++)
+            cNumberList::scan (ids.data (), ids.size (), false, out.data (), values, impls[k]);
+        double list = ids.size () / elapsedNs (start, iterations);
+
+        start = benchClock::now ();
+        for (unsigned n = 0; n < iterations; n++)
+            cNumberList::scan (cpus.data (), cpus.size (), true, out.data (), values, impls[k]);
+        double ranges = cpus.size () / elapsedNs (start, iterations);
+
+        std::printf ("%-28s %10s %14.2f %14.2f\n", "", names[k], list, ranges);
+    }
+}
+
+static void benchConsole ()
+{
+    const unsigned iterations = 10000000;
+    std::vector<std::string> words = {"alpha", "beta", "gamma", "delta"};
+
+    // disabled debug output with an argument that costs something
+    benchClock::time_point start = benchClock::now ();
+    for (unsigned n = 0; n < iterations; n++)
+        Console::PrintDebug ("%s %s\n", std::to_string (n).c_str (), words[n & 3].c_str ());
+    double call = elapsedNs (start, iterations);
+
+    start = benchClock::now ();
+    for (unsigned n = 0; n < iterations; n++)
+        CONSOLE_DEBUG ("%s %s\n", std::to_string (n).c_str (), words[n & 3].c_str ());
+    double macro = elapsedNs (start, iterations);
+
+    std::printf ("%-28s %10s %14s %14s\n", "disabled debug output", "", "call [ns]", "macro [ns]");
+    std::printf ("%-28s %10s %14.2f %14.2f\n", "", "", call, macro);
+
+    // formatting only, into memory
+    const unsigned messages = 2000000;
+    cMemorySink memory;
+    memory.init (64 * 1024);
+    Console::SetSink (&memory);
+    Console::SetPrintLevel (Console::Normal);
+
+    start = benchClock::now ();
+    for (unsigned n = 0; n < messages; n++)
+        Console::Print ("file %s line %d took %g ms (%u)\n", words[n & 3].c_str (), (int)n, n * 0.25, n);
+    double vararg = elapsedNs (start, messages);
+
+    start = benchClock::now ();
+    for (unsigned n = 0; n < messages; n++)
+        CONSOLE_FORMAT (Normal, "file {} line {} took {} ms ({})\n", words[n & 3], (int)n, n * 0.25, n);
+    double format = elapsedNs (start, messages);
+
+    double binary = 0;
+#ifndef HAVE_WINDOWS
+    char path[] = "/tmp/cmdline-benchmark-XXXXXX";
+    int fd = mkstemp (path);
+    if (fd >= 0 && cBinaryLog::open (path))
+    {
+        start = benchClock::now ();
+        for (unsigned n = 0; n < messages; n++)
+            CONSOLE_LOG (Normal, "file {} line {} took {} ms ({})\n", words[n & 3], (int)n, n * 0.25, n);
+        cBinaryLog::close ();
+        binary = elapsedNs (start, messages);
+        close (fd);
+        unlink (path);
+    }
+#endif
+
+    // nearly everything suppressed
+    start = benchClock::now ();
+    for (unsigned n = 0; n < messages; n++)
+        CONSOLE_LIMITED (Normal, 10, "file %s line %d took %g ms (%u)\n", words[n & 3].c_str (), (int)n, n * 0.25, n);
+    double limited = elapsedNs (start, messages);
+
+    start = benchClock::now ();
+    for (unsigned n = 0; n < messages; n++)
+        CONSOLE_SAMPLED (Normal, 1000, "file %s line %d took %g ms (%u)\n", words[n & 3].c_str (), (int)n, n * 0.25, n);
+    double sampled = elapsedNs (start, messages);
+    cConsoleLimit::printSuppressed ();
+
+    Console::SetPrintLevel (Console::Silent);
+    Console::SetSink (nullptr);
+    std::printf ("%-28s %10s %14s %14s\n", "limited output", "", "10/s [ns]", "1/1000 [ns]");
+    std::printf ("%-28s %10s %14.2f %14.2f\n", "", "", limited, sampled);
+    std::printf ("%-28s %10s %14s %14s %14s\n", "formatted output", "", "printf [ns]", "format [ns]", "binary [ns]");
+    std::printf ("%-28s %10s %14.2f %14.2f %14.2f\n", "", "", vararg, format, binary);
+
+#ifndef HAVE_WINDOWS
+    // output of many threads at once, to /dev/null
+    const unsigned lines = 20000;
+    int null = open ("/dev/null", O_WRONLY);
+    int saved = dup (2);
+    if (null < 0 || saved < 0 || dup2 (null, 2) != 2)
+        return;
+    Console::SetPrintLevel (Console::Normal);
+
+    std::printf ("%-28s %10s %14s\n", "console output", "threads", "lines [M/s]");
+    for (unsigned count : {1u, 8u, 64u})
+    {
+        std::vector<std::thread> threads;
+        start = benchClock::now ();
+        for (unsigned t = 0; t < count; t++)
+        {
+            threads.emplace_back ([t, &words]()
+            {
+                for (unsigned n = 0; n < lines; n++)
+                    Console::Print ("thread %u line %u %s\n", t, n, words[n & 3].c_str ());
+            });
+        }
+        for (auto& thread : threads)
+            thread.join ();
+        std::printf ("%-28s %10u %14.2f\n", "", count, 1000.0 / elapsedNs (start, count * lines));
+    }
+
+    Console::SetPrintLevel (Console::Silent);
+    dup2 (saved, 2);
+    close (saved);
+    close (null);
+#endif
+}
+
+static void benchWrap ()
+{
+    const unsigned iterations = 20;
+    std::string text;
+    unsigned x = 4711;
+    while (text.size () < 1024 * 1024)
+    {
+        x = x * 1103515245 + 12345;
+        text.append (x % 12 + 1, (char)('a' + x % 26));
+        text += x % 50 ? " " : " </br> ";
+    }
+
+    cMemorySink memory;
+    memory.init (4 * 1024 * 1024);
+    Console::SetSink (&memory);
+    Console::SetPrintLevel (Console::Normal);
+    benchClock::time_point start = benchClock::now ();
+    for (unsigned n = 0; n < iterations; n++)
+        Console::PrintWrapedText (text.c_str (), 100, 4, 8);
+    double rate = text.size () / elapsedNs (start, iterations);
+    Console::SetPrintLevel (Console::Silent);
+    Console::SetSink (nullptr);
+
+    std::printf ("%-28s %10s %14s\n", "wrapped text", "", "[GB/s]");
+    std::printf ("%-28s %10s %14.3f\n", "", "", rate);
+}
+
+// --help of a tool with many options, printed into memory
+static void benchHelp ()
+{
+    const unsigned optionCounts[] = {10, 100, 1000, 10000};
+
+    cMemorySink memory;
+    memory.init (4 * 1024 * 1024);
+    Console::SetSink (&memory);
+    Console::SetPrintLevel (Console::Normal);
+
+    std::printf ("%-28s %10s %14s %14s\n", "help", "options", "first [us]", "repeated [us]");
+    for (unsigned count : optionCounts)
+    {
+        cCmdline cmdline;
+        std::vector<std::string> names;
+        std::vector<int> isSet;
+        addOptions (cmdline, count, names, isSet);
+
+        benchClock::time_point start = benchClock::now ();
+        cmdline.printOptions ();
+        double first = elapsedNs (start, 1) / 1000;
+
+        const unsigned iterations = 100;
+        start = benchClock::now ();
+        for (unsigned n = 0; n < iterations; n++)
+            cmdline.printOptions ();
+        double repeated = elapsedNs (start, iterations) / 1000;
+
+        std::printf ("%-28s %10u %14.1f %14.1f\n", "", count, first, repeated);
+    }
+    Console::SetPrintLevel (Console::Silent);
+    Console::SetSink (nullptr);
+}
+
+// answer of the hidden --__complete entry for a tool with many options
+static void benchComplete ()
+{
+    const unsigned optionCounts[] = {10, 100, 1000};
+
+    std::printf ("%-28s %10s %14s %14s\n", "complete", "options", "prefix [ns]", "all [ns]");
+    for (unsigned count : optionCounts)
+    {
+        cCmdline cmdline;
+        std::vector<std::string> names;
+        std::vector<int> isSet;
+        addOptions (cmdline, count, names, isSet);
+
+        std::string out;
+        char* prefix[] = {(char*)"positional", (char*)"--option-1"};
+        char* all[] = {(char*)"-"};
+        const unsigned iterations = 1000;
+
+        benchClock::time_point start = benchClock::now ();
+        for (unsigned n = 0; n < iterations; n++)
+        {
+            out.clear ();
+            cmdline.complete (2, prefix, out);
+        }
+        double prefixNs = elapsedNs (start, iterations);
+
+        start = benchClock::now ();
+        for (unsigned n = 0; n < iterations; n++)
+        {
+            out.clear ();
+            cmdline.complete (1, all, out);
+        }
+        double allNs = elapsedNs (start, iterations);
+
+        std::printf ("%-28s %10u %14.0f %14.0f\n", "", count, prefixNs, allNs);
+    }
+}
+
+// a tool with 'commands' verbs of 'perCommand' options, either as subcommands or all in one option set
+class cBenchApp : public cCmdlineApp
+{
+public:
+    cBenchApp (const std::vector<std::string>& names, unsigned commands, unsigned perCommand, bool subcommands)
+    : cCmdlineApp ("bench", "benchmark", "bench [OPTIONS] COMMAND", "", "1.0")
+    {
+        for (unsigned c = 0; c < commands; c++)
+        {
+            const std::string* first = &names[c * (perCommand + 1)];
+            if (subcommands)
+            {
+                addSubcommand (first[0].c_str (), "benchmark command", "bench COMMAND",
+                    [this, first, perCommand](cCmdline& cmdline)
+                    {
+                        for (unsigned n = 1; n <= perCommand; n++)
+                            cmdline.addOption (true, 0, first[n].c_str (), "benchmark option", &isSet);
+                    },
+                    [](cArgSource&)
+                    {
+                        return 0;
+                    });
+            }
+            else
+            {
+                for (unsigned n = 1; n <= perCommand; n++)
+                    addCmdLineOption (true, 0, first[n].c_str (), "benchmark option", &isSet);
+            }
+        }
+    }
+
+protected:
+    int execute (const std::vector<std::string>&) override
+    {
+        return 0;
+    }
+
+private:
+    int isSet;
+};
+
+// construction and main of a tool with many verbs and options
+static void benchSubcommands ()
+{
+    const unsigned commands = 60;
+    const unsigned perCommand = 50;
+    const unsigned iterations = 100;
+
+    // per command its name and the names of its options
+    std::vector<std::string> names;
+    for (unsigned c = 0; c < commands; c++)
+    {
+        names.push_back ("cmd-" + std::to_string (c));
+        for (unsigned n = 0; n < perCommand; n++)
+            names.push_back (names[c * (perCommand + 1)] + "-option-" + std::to_string (n));
+    }
+    std::string option = "--" + names[7 * (perCommand + 1) + 3];
+
+    std::printf ("%-28s %10s %14s %14s\n", "startup", "options", "flat [us]", "verb [us]");
+    benchClock::time_point start = benchClock::now ();
+    for (unsigned n = 0; n < iterations; n++)
+    {
+        char* argv[] = {(char*)"bench", &option[0], (char*)"x", NULL};
+        cBenchApp app (names, commands, perCommand, false);
+        app.main (3, argv);
+    }
+    double flat = elapsedNs (start, iterations) / 1000;
+
+    start = benchClock::now ();
+    for (unsigned n = 0; n < iterations; n++)
+    {
+        char* argv[] = {(char*)"bench", (char*)"cmd-7", &option[0], (char*)"x", NULL};
+        cBenchApp app (names, commands, perCommand, true);
+        app.main (4, argv);
+    }
+    double verb = elapsedNs (start, iterations) / 1000;
+
+    std::printf ("%-28s %10u %14.1f %14.1f\n", "", commands * perCommand, flat, verb);
+}
+
+int main (void)
+{
+    Console::SetPrintLevel (Console::Silent);
+
+    benchParse ();
+    benchPermute ();
+    benchBatch ();
+    benchNumberList ();
+    benchConsole ();
+    benchWrap ();
+    benchHelp ();
+    benchComplete ();
+    benchSubcommands ();
+
+    return 0;
+}
@@ -26,6 +26,8 @@ Example::Example (const char* name, const char* brief, const char* usage, const
     addCmdLineOption (true, 'c', "liz", "TEXT", "Optional option with string argument", &m_options.argC);
     addCmdLineOption (true, "susi", "INT", "Optional long-only option with optional string argument", &m_options.argD_isSet, &m_options.argD);
     addCmdLineOption (true, 'e', "peter", "Optional boolean option", &m_options.argE);
+    enableArgsFrom ();
+    enableResponseFiles ();
 }
 
 Example::~Example()
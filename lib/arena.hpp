@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ARENA_HPP_
+#define ARENA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Bump allocator on top of caller supplied storage. Nothing is ever taken from the global heap; if the
+// storage is exhausted, allocate throws std::bad_alloc. Only the most recent allocation can be given back.
+// The storage must outlive every object using the arena.
+class cArena
+{
+public:
+    cArena (void* buffer, size_t size)
+    {
+        this->buffer = static_cast<char*>(buffer);
+        this->size   = size;
+        this->top    = 0;
+    }
+
+    void* allocate (size_t bytes, size_t alignment)
+    {
+        uintptr_t base  = reinterpret_cast<uintptr_t>(buffer);
+        size_t    start = (size_t)(((base + top + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+        if (start > size || bytes > size - start)
+            throw std::bad_alloc ();
+        top = start + bytes;
+        return buffer + start;
+    }
+
+    void deallocate (void* p, size_t bytes)
+    {
+        // typical for a growing vector: the old block is released right after the new one was allocated,
+        // so this rarely matches; but it's cheap
+        if (static_cast<char*>(p) + bytes == buffer + top)
+            top = (size_t)(static_cast<char*>(p) - buffer);
+    }
+
+    size_t used () const
+    {
+        return top;
+    }
+    size_t capacity () const
+    {
+        return size;
+    }
+
+private:
+    char*  buffer;
+    size_t size;
+    size_t top;
+};
+
+
+// std allocator that takes memory from a cArena or, without arena, from the global heap
+template <typename T>
+class cArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    cArenaAllocator (cArena* arena = nullptr) noexcept : arena (arena)
+    {
+    }
+    template <typename U>
+    cArenaAllocator (const cArenaAllocator<U>& other) noexcept : arena (other.arena)
+    {
+    }
+
+    T* allocate (size_t n)
+    {
+        if (arena)
+            return static_cast<T*>(arena->allocate (n * sizeof (T), alignof (T)));
+        return static_cast<T*>(::operator new (n * sizeof (T)));
+    }
+    void deallocate (T* p, size_t n) noexcept
+    {
+        if (arena)
+            arena->deallocate (p, n * sizeof (T));
+        else
+            ::operator delete (p);
+    }
+
+    cArena* arena;
+};
+
+template <typename T, typename U>
+bool operator== (const cArenaAllocator<T>& a, const cArenaAllocator<U>& b) noexcept
+{
+    return a.arena == b.arena;
+}
+template <typename T, typename U>
+bool operator!= (const cArenaAllocator<T>& a, const cArenaAllocator<U>& b) noexcept
+{
+    return a.arena != b.arena;
+}
+
+#endif /* ARENA_HPP_ */
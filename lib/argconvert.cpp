@@ -0,0 +1,410 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <climits>
+#include <cstring>
+#include <locale>
+#include <sstream>
+#include <string>
+
+#include "argconvert.hpp"
+#include "bug.hpp"
+#include "console.hpp"
+
+
+// Accumulates the digits of 'base' at 's' and advances 's' behind them. 'overflow' is set if the number doesn't
+// fit into 64 bits; the digits are consumed anyway, so that format errors take precedence over range errors.
+static bool scanDigits (const char*& s, unsigned base, uint64_t& value, bool& overflow)
+{
+    const char* start = s;
+    uint64_t v = 0;
+    for (;; s++)
+    {
+        unsigned d;
+        char c = *s;
+        if (c >= '0' && c <= '9')
+            d = (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            d = (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            d = (unsigned)(c - 'A' + 10);
+        else
+            break;
+        if (d >= base)
+            break;
+        if (v > (UINT64_MAX - d) / base)
+            overflow = true;
+        else
+            v = v * base + d;
+    }
+    value = v;
+    return s != start;
+}
+
+// integer like strtoull with base 0: decimal, 0x hexadecimal or 0 octal
+static bool scanInteger (const char*& s, uint64_t& value, bool& overflow)
+{
+    unsigned base = 10;
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    {
+        base = 16;
+        s += 2;
+    }
+    else if (s[0] == '0' && s[1])
+    {
+        base = 8;
+        s++;
+    }
+    return scanDigits (s, base, value, overflow);
+}
+
+
+cmdline_error cArgConvert::convert (arg_type type, const char* arg, argValue& value)
+{
+    switch (type)
+    {
+    case ARG_INT:
+        return toInt64 (arg, INT_MIN, INT_MAX, value.i);
+    case ARG_INT64:
+        return toInt64 (arg, INT64_MIN, INT64_MAX, value.i);
+    case ARG_UINT64:
+        return toUint64 (arg, value.u);
+    case ARG_DOUBLE:
+        return toDouble (arg, value.d);
+    case ARG_SIZE:
+        return toSize (arg, value.u);
+    case ARG_DURATION:
+        return toDuration (arg, value.i);
+    default:
+        return CMDLINE_OK;
+    }
+}
+
+cmdline_error cArgConvert::toInt64 (const char* arg, int64_t min, int64_t max, int64_t& value)
+{
+    bool negative = *arg == '-';
+    if (*arg == '-' || *arg == '+')
+        arg++;
+
+    uint64_t v;
+    bool overflow = false;
+    if (!scanInteger (arg, v, overflow) || *arg)
+        return CMDLINE_INVALID_ARGUMENT;
+
+    if (negative)
+    {
+        // -(min + 1) + 1 avoids overflowing -min
+        if (overflow || v > (uint64_t)-(min + 1) + 1)
+            return CMDLINE_OUT_OF_RANGE;
+        value = v ? -(int64_t)(v - 1) - 1 : 0;
+    }
+    else
+    {
+        if (overflow || v > (uint64_t)max)
+            return CMDLINE_OUT_OF_RANGE;
+        value = (int64_t)v;
+    }
+    return CMDLINE_OK;
+}
+
+cmdline_error cArgConvert::toUint64 (const char* arg, uint64_t& value)
+{
+    if (*arg == '+')
+        arg++;
+
+    uint64_t v;
+    bool overflow = false;
+    if (!scanInteger (arg, v, overflow) || *arg)
+        return CMDLINE_INVALID_ARGUMENT;
+    if (overflow)
+        return CMDLINE_OUT_OF_RANGE;
+    value = v;
+    return CMDLINE_OK;
+}
+
+cmdline_error cArgConvert::toDouble (const char* arg, double& value)
+{
+    // exactly representable powers of ten
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char* s = arg;
+    bool negative = *s == '-';
+    if (*s == '-' || *s == '+')
+        s++;
+
+    // [digits][.digits][(e|E)[sign]digits] with at least one digit in the mantissa
+    uint64_t mantissa = 0;
+    int digits = 0;     // significant digits in 'mantissa'
+    int dropped = 0;    // significant digits that didn't fit into 'mantissa'
+    int exponent = 0;
+    bool any = false;
+    for (; *s >= '0' && *s <= '9'; s++)
+    {
+        any = true;
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (unsigned)(*s - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            dropped++;
+        }
+    }
+    if (*s == '.')
+    {
+        for (s++; *s >= '0' && *s <= '9'; s++)
+        {
+            any = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (unsigned)(*s - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+            else
+            {
+                dropped++;
+            }
+        }
+    }
+    if (!any)
+        return CMDLINE_INVALID_ARGUMENT;
+    if (*s == 'e' || *s == 'E')
+    {
+        s++;
+        bool negativeExp = *s == '-';
+        if (*s == '-' || *s == '+')
+            s++;
+        if (*s < '0' || *s > '9')
+            return CMDLINE_INVALID_ARGUMENT;
+        int e = 0;
+        for (; *s >= '0' && *s <= '9'; s++)
+        {
+            if (e < 100000)
+                e = e * 10 + (*s - '0');
+        }
+        exponent += negativeExp ? -e : e;
+    }
+    if (*s)
+        return CMDLINE_INVALID_ARGUMENT;
+
+    // Fast path: mantissa and power of ten are exact doubles, so one multiplication or division rounds correctly.
+    // Everything else is left to the classic locale of the standard library.
+    if (!dropped && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        double d = (double)mantissa;
+        d = exponent < 0 ? d / pow10[-exponent] : d * pow10[exponent];
+        value = negative ? -d : d;
+        return CMDLINE_OK;
+    }
+
+    std::istringstream in (arg);
+    in.imbue (std::locale::classic ());
+    double d;
+    in >> d;
+    if (in.fail ())
+        return CMDLINE_OUT_OF_RANGE;
+    value = d;
+    return CMDLINE_OK;
+}
+
+cmdline_error cArgConvert::toSize (const char* arg, uint64_t& value)
+{
+    uint64_t v;
+    bool overflow = false;
+    if (!scanDigits (arg, 10, v, overflow))
+        return CMDLINE_INVALID_ARGUMENT;
+
+    // binary multipliers, optionally followed by "iB" or "B"
+    static const char units[] = "kmgtpe";
+    unsigned shift = 0;
+    char c = *arg >= 'A' && *arg <= 'Z' ? (char)(*arg - 'A' + 'a') : *arg;
+    const char* unit = c ? strchr (units, c) : NULL;
+    if (unit)
+    {
+        shift = 10 * (unsigned)(unit - units + 1);
+        arg++;
+        if (*arg == 'i')
+        {
+            arg++;
+            if (*arg != 'B')
+                return CMDLINE_INVALID_ARGUMENT;
+        }
+    }
+    if (*arg == 'B')
+        arg++;
+    if (*arg)
+        return CMDLINE_INVALID_ARGUMENT;
+
+    if (overflow || (shift && v > (UINT64_MAX >> shift)))
+        return CMDLINE_OUT_OF_RANGE;
+    value = v << shift;
+    return CMDLINE_OK;
+}
+
+cmdline_error cArgConvert::toDuration (const char* arg, int64_t& value)
+{
+    static const struct
+    {
+        const char* name;
+        int64_t     ns;
+    }units[] = {
+        {"ns", 1},
+        {"us", 1000},
+        {"ms", 1000000},
+        {"s",  1000000000LL},
+        {"m",  60 * 1000000000LL},
+        {"h",  3600 * 1000000000LL},
+        {"d",  86400 * 1000000000LL}
+    };
+
+    // "0" is the only number without unit
+    if (arg[0] == '0' && !arg[1])
+    {
+        value = 0;
+        return CMDLINE_OK;
+    }
+
+    // sequence of numbers with units, e.g. 1h30m
+    uint64_t total = 0;
+    bool overflow = false;
+    do
+    {
+        uint64_t v;
+        if (!scanDigits (arg, 10, v, overflow))
+            return CMDLINE_INVALID_ARGUMENT;
+
+        const char* name = arg;
+        while (*arg >= 'a' && *arg <= 'z')
+            arg++;
+        size_t len = (size_t)(arg - name);
+        size_t n = 0;
+        for (; n < sizeof (units) / sizeof (units[0]); n++)
+        {
+            if (strlen (units[n].name) == len && !strncmp (units[n].name, name, len))
+                break;
+        }
+        if (n == sizeof (units) / sizeof (units[0]))
+            return CMDLINE_INVALID_ARGUMENT;
+
+        uint64_t ns = (uint64_t)units[n].ns;
+        if (v > (INT64_MAX - total) / ns)
+            overflow = true;
+        else
+            total += v * ns;
+    } while (*arg);
+
+    if (overflow)
+        return CMDLINE_OUT_OF_RANGE;
+    value = (int64_t)total;
+    return CMDLINE_OK;
+}
+
+
+#ifdef WITH_UNITTESTS
+void cArgConvert::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+    {
+        int64_t v = 1;
+        BUG_IF_NOT (toInt64 ("0", INT_MIN, INT_MAX, v) == CMDLINE_OK && v == 0);
+        BUG_IF_NOT (toInt64 ("-0", INT_MIN, INT_MAX, v) == CMDLINE_OK && v == 0);
+        BUG_IF_NOT (toInt64 ("+42", INT_MIN, INT_MAX, v) == CMDLINE_OK && v == 42);
+        BUG_IF_NOT (toInt64 ("0x7fffffff", INT_MIN, INT_MAX, v) == CMDLINE_OK && v == INT_MAX);
+        BUG_IF_NOT (toInt64 ("-2147483648", INT_MIN, INT_MAX, v) == CMDLINE_OK && v == INT_MIN);
+        BUG_IF_NOT (toInt64 ("010", INT_MIN, INT_MAX, v) == CMDLINE_OK && v == 8);
+        BUG_IF_NOT (toInt64 ("2147483648", INT_MIN, INT_MAX, v) == CMDLINE_OUT_OF_RANGE);
+        BUG_IF_NOT (toInt64 ("-2147483649", INT_MIN, INT_MAX, v) == CMDLINE_OUT_OF_RANGE);
+        BUG_IF_NOT (toInt64 ("9223372036854775807", INT64_MIN, INT64_MAX, v) == CMDLINE_OK && v == INT64_MAX);
+        BUG_IF_NOT (toInt64 ("-9223372036854775808", INT64_MIN, INT64_MAX, v) == CMDLINE_OK && v == INT64_MIN);
+        BUG_IF_NOT (toInt64 ("9223372036854775808", INT64_MIN, INT64_MAX, v) == CMDLINE_OUT_OF_RANGE);
+        BUG_IF_NOT (toInt64 ("99999999999999999999999", INT64_MIN, INT64_MAX, v) == CMDLINE_OUT_OF_RANGE);
+        BUG_IF_NOT (toInt64 ("99999999999999999999999x", INT64_MIN, INT64_MAX, v) == CMDLINE_INVALID_ARGUMENT);
+        BUG_IF_NOT (v == INT64_MIN);
+        const char* invalid[] = {"", "-", "+", " 1", "1 ", "1x", "0x", "08", "--1", "1.0", "1e3"};
+        for (const char* s : invalid)
+            BUG_IF_NOT (toInt64 (s, INT64_MIN, INT64_MAX, v) == CMDLINE_INVALID_ARGUMENT);
+    }
+    {
+        uint64_t v;
+        BUG_IF_NOT (toUint64 ("18446744073709551615", v) == CMDLINE_OK && v == UINT64_MAX);
+        BUG_IF_NOT (toUint64 ("0xFFFFFFFFFFFFFFFF", v) == CMDLINE_OK && v == UINT64_MAX);
+        BUG_IF_NOT (toUint64 ("18446744073709551616", v) == CMDLINE_OUT_OF_RANGE);
+        BUG_IF_NOT (toUint64 ("-1", v) == CMDLINE_INVALID_ARGUMENT);
+    }
+    {
+        double v;
+        BUG_IF_NOT (toDouble ("1.5", v) == CMDLINE_OK && v == 1.5);
+        BUG_IF_NOT (toDouble ("-.25", v) == CMDLINE_OK && v == -0.25);
+        BUG_IF_NOT (toDouble ("3.", v) == CMDLINE_OK && v == 3.0);
+        BUG_IF_NOT (toDouble ("0.1", v) == CMDLINE_OK && v == 0.1);
+        BUG_IF_NOT (toDouble ("1e-3", v) == CMDLINE_OK && v == 1e-3);
+        BUG_IF_NOT (toDouble ("6.02214076E+23", v) == CMDLINE_OK && v == 6.02214076e23);
+        BUG_IF_NOT (toDouble ("0.30000000000000000000001", v) == CMDLINE_OK && v == 0.30000000000000000000001);
+        BUG_IF_NOT (toDouble ("123456789012345678901234567890", v) == CMDLINE_OK && v == 123456789012345678901234567890.0);
+        BUG_IF_NOT (toDouble ("1e400", v) == CMDLINE_OUT_OF_RANGE);
+        const char* invalid[] = {"", ".", "-", "e5", "1e", "1e+", "1.5x", "1,5", " 1", "inf", "nan", "0x10"};
+        for (const char* s : invalid)
+            BUG_IF_NOT (toDouble (s, v) == CMDLINE_INVALID_ARGUMENT);
+    }
+    {
+        uint64_t v;
+        BUG_IF_NOT (toSize ("4096", v) == CMDLINE_OK && v == 4096);
+        BUG_IF_NOT (toSize ("64k", v) == CMDLINE_OK && v == 65536);
+        BUG_IF_NOT (toSize ("4G", v) == CMDLINE_OK && v == 4ULL << 30);
+        BUG_IF_NOT (toSize ("4GiB", v) == CMDLINE_OK && v == 4ULL << 30);
+        BUG_IF_NOT (toSize ("2mB", v) == CMDLINE_OK && v == 2ULL << 20);
+        BUG_IF_NOT (toSize ("100B", v) == CMDLINE_OK && v == 100);
+        BUG_IF_NOT (toSize ("15E", v) == CMDLINE_OK && v == 15ULL << 60);
+        BUG_IF_NOT (toSize ("16E", v) == CMDLINE_OUT_OF_RANGE);
+        BUG_IF_NOT (toSize ("16777216T", v) == CMDLINE_OUT_OF_RANGE);
+        const char* invalid[] = {"", "k", "-1k", "1.5G", "4Gi", "4GiBx", "4x", "0x10", "4 G"};
+        for (const char* s : invalid)
+            BUG_IF_NOT (toSize (s, v) == CMDLINE_INVALID_ARGUMENT);
+    }
+    {
+        int64_t v;
+        BUG_IF_NOT (toDuration ("0", v) == CMDLINE_OK && v == 0);
+        BUG_IF_NOT (toDuration ("250ms", v) == CMDLINE_OK && v == 250000000);
+        BUG_IF_NOT (toDuration ("2h", v) == CMDLINE_OK && v == 7200 * 1000000000LL);
+        BUG_IF_NOT (toDuration ("1h30m", v) == CMDLINE_OK && v == 5400 * 1000000000LL);
+        BUG_IF_NOT (toDuration ("1s500us7ns", v) == CMDLINE_OK && v == 1000500007);
+        BUG_IF_NOT (toDuration ("106751d", v) == CMDLINE_OK);
+        BUG_IF_NOT (toDuration ("106752d", v) == CMDLINE_OUT_OF_RANGE);
+        BUG_IF_NOT (toDuration ("9223372036854775807ns", v) == CMDLINE_OK && v == INT64_MAX);
+        BUG_IF_NOT (toDuration ("9223372036854775807ns1ns", v) == CMDLINE_OUT_OF_RANGE);
+        const char* invalid[] = {"", "1", "10", "ms", "-1s", "1.5s", "1sec", "1s 2s", "1S", "1h30"};
+        for (const char* s : invalid)
+            BUG_IF_NOT (toDuration (s, v) == CMDLINE_INVALID_ARGUMENT);
+    }
+    {
+        argValue v;
+        BUG_IF_NOT (convert (ARG_STRING, "x", v) == CMDLINE_OK);
+        BUG_IF_NOT (convert (ARG_INT, "-7", v) == CMDLINE_OK && v.i == -7);
+        BUG_IF_NOT (convert (ARG_UINT64, "7", v) == CMDLINE_OK && v.u == 7);
+        BUG_IF_NOT (convert (ARG_DOUBLE, "7", v) == CMDLINE_OK && v.d == 7.0);
+        BUG_IF_NOT (convert (ARG_SIZE, "7k", v) == CMDLINE_OK && v.u == 7168);
+        BUG_IF_NOT (convert (ARG_DURATION, "7us", v) == CMDLINE_OK && v.i == 7000);
+        BUG_IF_NOT (convert (ARG_INT64, "7x", v) == CMDLINE_INVALID_ARGUMENT);
+    }
+}
+#endif
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ARGCONVERT_HPP_
+#define ARGCONVERT_HPP_
+
+#include "cmdline.hpp"
+
+// Strict, locale independent conversion of option arguments. The whole argument must be a number of the type (no
+// leading whitespace, no trailing characters) and it must fit into the type; nothing is truncated.
+class cArgConvert
+{
+public:
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    // returns CMDLINE_OK, CMDLINE_INVALID_ARGUMENT or CMDLINE_OUT_OF_RANGE; 'value' is only set on success.
+    // Types without numeric argument are always CMDLINE_OK.
+    static cmdline_error convert (arg_type type, const char* arg, argValue& value);
+
+    static cmdline_error toInt64 (const char* arg, int64_t min, int64_t max, int64_t& value);
+    static cmdline_error toUint64 (const char* arg, uint64_t& value);
+    static cmdline_error toDouble (const char* arg, double& value);
+    static cmdline_error toSize (const char* arg, uint64_t& value);
+    static cmdline_error toDuration (const char* arg, int64_t& value);
+};
+
+#endif /* ARGCONVERT_HPP_ */
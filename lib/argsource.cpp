@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdlib>
+#include <cstring>
+
+#include "argsource.hpp"
+#include "bug.hpp"
+#include "console.hpp"
+
+
+cArgSource::cArgSource (int argc, char* argv[])
+{
+    this->argc      = argc;
+    this->argv      = argv;
+    this->index     = 0;
+    this->file      = NULL;
+    this->separator = '\n';
+    this->eof       = true;
+    this->readError = false;
+    this->pos       = 0;
+    this->filled    = 0;
+}
+
+cArgSource::~cArgSource ()
+{
+    if (file && file != stdin)
+        fclose (file);
+}
+
+bool cArgSource::open (const char* path, bool nulSeparated, size_t bufferSize)
+{
+    BUG_ON (file || bufferSize < 2);
+
+    file = strcmp (path, "-") ? fopen (path, "rb") : stdin;
+    if (!file)
+        return false;
+    // we read large chunks, an additional stdio buffer would just copy everything once more
+    setvbuf (file, NULL, _IONBF, 0);
+
+    separator = nulSeparated ? '\0' : '\n';
+    eof       = false;
+    pos       = 0;
+    filled    = 0;
+    try
+    {
+        // one byte more to terminate the last argument
+        buffer.resize (bufferSize + 1);
+    }
+    catch (const std::bad_alloc&)
+    {
+        readError = true;
+        eof = true;
+    }
+    return !readError;
+}
+
+// moves the unprocessed rest to the beginning of the buffer and reads as much as fits behind it
+bool cArgSource::fill ()
+{
+    size_t rest = filled - pos;
+    if (pos)
+        memmove (buffer.data (), buffer.data () + pos, rest);
+    pos    = 0;
+    filled = rest;
+
+    if (filled == buffer.size () - 1)
+    {
+        // a single argument is larger than the buffer
+        try
+        {
+            buffer.resize ((buffer.size () - 1) * 2 + 1);
+        }
+        catch (const std::bad_alloc&)
+        {
+            readError = true;
+            return false;
+        }
+    }
+
+    size_t n = fread (buffer.data () + filled, 1, buffer.size () - 1 - filled, file);
+    filled += n;
+    if (n == 0)
+    {
+        eof = true;
+        if (ferror (file))
+            readError = true;
+    }
+    return !readError;
+}
+
+const char* cArgSource::next (size_t* len)
+{
+    if (index < argc)
+    {
+        const char* arg = argv[index++];
+        if (len)
+            *len = strlen (arg);
+        return arg;
+    }
+
+    while (!readError && (pos < filled || !eof))
+    {
+        char* start = buffer.data () + pos;
+        char* end   = static_cast<char*>(memchr (start, separator, filled - pos));
+        if (!end && eof)
+            end = buffer.data () + filled;  // last argument without separator
+        if (end)
+        {
+            size_t endPos = end - buffer.data ();
+            pos  = endPos < filled ? endPos + 1 : filled;
+            *end = '\0';
+            if (end == start)
+                continue;  // empty argument
+            if (len)
+                *len = end - start;
+            return start;
+        }
+        if (!fill ())
+            break;
+    }
+    return NULL;
+}
+
+
+#ifdef WITH_UNITTESTS
+void cArgSource::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+    const char* argv[] = {"ABCD", "EFGH"};
+    const char newlineContent[] = "first\nsecond\n\nthird-argument-that-is-longer-than-the-buffer\nlast";
+    const char nulContent[] = "first\0sec ond\n\0\0third-argument-that-is-longer-than-the-buffer\0last\n\0";
+    const char* expectedNewline[] = {"ABCD", "EFGH", "first", "second", "third-argument-that-is-longer-than-the-buffer",
+            "last", NULL};
+    const char* expectedNul[] = {"ABCD", "EFGH", "first", "sec ond\n", "third-argument-that-is-longer-than-the-buffer",
+            "last\n", NULL};
+
+#ifndef HAVE_WINDOWS
+    for (int nul = 0; nul < 2; nul++)
+    {
+        char path[] = "/tmp/cmdline-unittest-XXXXXX";
+        FILE* f = fdopen (mkstemp (path), "wb");
+        BUG_IF_NOT (f);
+        size_t size = nul ? sizeof (nulContent) - 1 : sizeof (newlineContent) - 1;
+        BUG_IF_NOT (fwrite (nul ? nulContent : newlineContent, 1, size, f) == size);
+        fclose (f);
+
+        for (size_t bufferSize = 2; bufferSize <= 4096; bufferSize *= 8)
+        {
+            const char** expected = nul ? expectedNul : expectedNewline;
+            cArgSource args (2, (char**)argv);
+            BUG_IF_NOT (args.open (path, nul != 0, bufferSize));
+
+            const char* arg;
+            size_t len;
+            int n = 0;
+            while ((arg = args.next (&len)) != NULL)
+            {
+                BUG_IF_NOT (expected[n]);
+                BUG_IF_NOT (len == strlen (expected[n]) && !strcmp (arg, expected[n]));
+                n++;
+            }
+            BUG_IF_NOT (!expected[n]);
+            BUG_IF_NOT (!args.error ());
+        }
+        remove (path);
+    }
+#endif
+
+    cArgSource args (0, NULL);
+    BUG_IF_NOT (!args.open ("/nonexistent/cmdline-unittest", false));
+    BUG_IF_NOT (!args.next ());
+}
+#endif
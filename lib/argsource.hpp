@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ARGSOURCE_HPP_
+#define ARGSOURCE_HPP_
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+// Positional arguments of an application: first the remaining ones from argv, then optionally the ones read
+// from a file or stdin, separated by newlines or '\0' (like xargs -0). The file is read in large chunks, memory
+// usage doesn't depend on the number of arguments. Empty arguments in the file are skipped.
+class cArgSource
+{
+public:
+    cArgSource (int argc, char* argv[]);
+    ~cArgSource ();
+    cArgSource (const cArgSource&) = delete;
+    cArgSource& operator= (const cArgSource&) = delete;
+
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    // appends the arguments in 'path' ("-" is stdin)
+    bool open (const char* path, bool nulSeparated, size_t bufferSize = 1024 * 1024);
+
+    // returns the next argument or NULL at the end; it is valid until the next call
+    const char* next (size_t* len = nullptr);
+    // true if reading the file failed; there are no more arguments then
+    bool error () const
+    {
+        return readError;
+    }
+
+private:
+    int    argc;
+    char** argv;
+    int    index;
+
+    FILE*  file;
+    char   separator;
+    bool   eof;
+    bool   readError;
+    std::vector<char> buffer;
+    size_t pos;     // start of the next argument
+    size_t filled;  // end of valid data
+
+    bool fill ();
+};
+
+#endif /* ARGSOURCE_HPP_ */
@@ -0,0 +1,706 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#ifdef WITH_UNITTESTS
+#include <cstdio>
+#endif
+#ifdef HAVE_WINDOWS
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "binarylog.hpp"
+#include "bug.hpp"
+#include "consolesink.hpp"
+#include "responsefile.hpp"
+
+
+static const char MAGIC[8] = {'C', 'M', 'D', 'B', 'L', 'O', 'G', '1'};
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+// magic, byte order mark, u64 steady clock at open
+static const size_t HEADER_SIZE = 20;
+
+std::atomic<bool> cBinaryLog::active (false);
+
+static std::atomic<int> logFd (-1);
+static uint64_t logStart;
+// serializes open, close and define
+static std::mutex logMtx;
+static uint32_t nextId = 1;
+
+typedef struct
+{
+    uint32_t    id;
+    int         level;
+    const char* format;
+    const char* types;
+}siteDefinition;
+
+// all call sites defined so far; they are written again to each new file
+static std::vector<siteDefinition>& definitions ()
+{
+    static std::vector<siteDefinition>* list = new std::vector<siteDefinition> ();
+    return *list;
+}
+
+// Messages of one thread. The owner holds 'busy' while writing a message, close uses it to flush all buffers.
+struct threadBuffer
+{
+    std::atomic_flag busy;
+    char*    data;
+    size_t   used;
+    uint32_t thread;
+
+    threadBuffer ();
+    ~threadBuffer ();
+    void lock ()
+    {
+        while (busy.test_and_set (std::memory_order_acquire))
+            std::this_thread::yield ();
+    }
+    void unlock ()
+    {
+        busy.clear (std::memory_order_release);
+    }
+    void flush ();
+};
+
+static std::mutex buffersMtx;
+static std::vector<threadBuffer*>& buffers ()
+{
+    static std::vector<threadBuffer*>* list = new std::vector<threadBuffer*> ();
+    return *list;
+}
+static uint32_t nextThread = 0;
+
+// 'current' is a plain pointer, so the hot path doesn't go through the initialization check of 'ownBuffer'
+static thread_local threadBuffer* current = NULL;
+// set when 'ownBuffer' is destroyed; the main thread's is gone before the atexit handlers and global destructors run
+static thread_local bool retired = false;
+
+// Shared by all threads whose own buffer is destroyed. It is never destroyed itself and each message is written out
+// at once, since nothing flushes it later. NULL without memory.
+static threadBuffer* lateBuffer ()
+{
+    static threadBuffer* buffer = new (std::nothrow) threadBuffer ();
+    return buffer;
+}
+
+static threadBuffer* currentBuffer ()
+{
+    if (current)
+        return current;
+    if (retired)
+        return lateBuffer ();
+    static thread_local threadBuffer ownBuffer;
+    current = &ownBuffer;
+    return current;
+}
+
+
+static bool writeAll (int fd, const char* head, size_t headLen, const char* data, size_t len)
+{
+#ifdef HAVE_WINDOWS
+    return _write (fd, head, (unsigned)headLen) == (int)headLen && (!len || _write (fd, data, (unsigned)len) == (int)len);
+#else
+    // one call, so records of different threads don't mix in the O_APPEND file
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(head);
+    iov[0].iov_len  = headLen;
+    iov[1].iov_base = const_cast<char*>(data);
+    iov[1].iov_len  = len;
+    return writev (fd, iov, 2) == (ssize_t)(headLen + len);
+#endif
+}
+
+static void writeDefinition (int fd, const siteDefinition& def)
+{
+    size_t types = strlen (def.types);
+    uint32_t formatLen = (uint32_t)strlen (def.format);
+    char head[16 + 256];
+    char* p = head;
+    *p++ = 'D';
+    memcpy (p, &def.id, 4);
+    p += 4;
+    *p++ = (char)def.level;
+    *p++ = (char)types;
+    memcpy (p, def.types, types);
+    p += types;
+    memcpy (p, &formatLen, 4);
+    p += 4;
+    writeAll (fd, head, (size_t)(p - head), def.format, formatLen);
+}
+
+
+threadBuffer::threadBuffer ()
+{
+    busy.clear ();
+    data = NULL;
+    used = 0;
+    std::lock_guard<std::mutex> lock (buffersMtx);
+    thread = nextThread++;
+    try
+    {
+        buffers ().push_back (this);
+    }
+    catch (const std::bad_alloc&)
+    {
+        // never allocates its buffer, see reserve
+        thread = UINT32_MAX;
+    }
+}
+
+threadBuffer::~threadBuffer ()
+{
+    {
+        std::lock_guard<std::mutex> lock (buffersMtx);
+        std::vector<threadBuffer*>& list = buffers ();
+        list.erase (std::remove (list.begin (), list.end (), this), list.end ());
+    }
+    flush ();
+    delete[] data;
+    if (current == this)
+    {
+        current = NULL;
+        retired = true;
+    }
+}
+
+void threadBuffer::flush ()
+{
+    int fd = logFd.load (std::memory_order_acquire);
+    if (used && fd >= 0)
+    {
+        char head[9];
+        uint32_t len = (uint32_t)used;
+        head[0] = 'C';
+        memcpy (head + 1, &thread, 4);
+        memcpy (head + 5, &len, 4);
+        writeAll (fd, head, sizeof (head), data, used);
+    }
+    used = 0;
+}
+
+
+bool cBinaryLog::open (const char* path)
+{
+    close ();
+    std::lock_guard<std::mutex> lock (logMtx);
+#ifdef HAVE_WINDOWS
+    int fd = _open (path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_APPEND | _O_BINARY, 0644);
+#else
+    int fd = ::open (path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+#endif
+    if (fd < 0)
+        return false;
+
+    logStart = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+    char header[HEADER_SIZE];
+    memcpy (header, MAGIC, 8);
+    memcpy (header + 8, &BYTE_ORDER_MARK, 4);
+    memcpy (header + 12, &logStart, 8);
+    if (!writeAll (fd, header, sizeof (header), NULL, 0))
+    {
+#ifdef HAVE_WINDOWS
+        _close (fd);
+#else
+        ::close (fd);
+#endif
+        return false;
+    }
+    for (const siteDefinition& def : definitions ())
+        writeDefinition (fd, def);
+
+    logFd.store (fd, std::memory_order_release);
+    active.store (true, std::memory_order_release);
+    return true;
+}
+
+void cBinaryLog::close ()
+{
+    std::lock_guard<std::mutex> lock (logMtx);
+    int fd = logFd.load ();
+    if (fd < 0)
+        return;
+    active = false;
+    {
+        std::lock_guard<std::mutex> lock (buffersMtx);
+        for (threadBuffer* buffer : buffers ())
+        {
+            buffer->lock ();
+            buffer->flush ();
+            buffer->unlock ();
+        }
+    }
+    logFd = -1;
+#ifdef HAVE_WINDOWS
+    _close (fd);
+#else
+    ::close (fd);
+#endif
+}
+
+void cBinaryLog::flush ()
+{
+    threadBuffer* buffer = currentBuffer ();
+    if (!buffer)
+        return;
+    buffer->lock ();
+    buffer->flush ();
+    buffer->unlock ();
+}
+
+uint32_t cBinaryLog::define (cBinaryLogSite& site, int level, const char* format, const char* types)
+{
+    std::lock_guard<std::mutex> lock (logMtx);
+    uint32_t id = site.id.load (std::memory_order_relaxed);
+    if (id)
+        return id;
+
+    siteDefinition def = {nextId, level, format, types};
+    try
+    {
+        definitions ().push_back (def);
+    }
+    catch (const std::bad_alloc&)
+    {
+        // the messages of this site are dropped, see binaryLog::log
+        return 0;
+    }
+    nextId++;
+    int fd = logFd.load ();
+    if (fd >= 0)
+        writeDefinition (fd, def);
+    site.id.store (def.id, std::memory_order_release);
+    return def.id;
+}
+
+char* cBinaryLog::reserve (size_t len)
+{
+    threadBuffer* found = current ? current : currentBuffer ();
+    if (!found)
+        return NULL;
+    threadBuffer& buffer = *found;
+    if (len > BUFFER_SIZE || buffer.thread == UINT32_MAX)
+        return NULL;
+    buffer.lock ();
+    if (!buffer.data)
+    {
+        buffer.data = new (std::nothrow) char[BUFFER_SIZE];
+        if (!buffer.data)
+        {
+            buffer.unlock ();
+            return NULL;
+        }
+    }
+    if (buffer.used + len > BUFFER_SIZE)
+        buffer.flush ();
+    return buffer.data + buffer.used;
+}
+
+void cBinaryLog::commit (char* end)
+{
+    threadBuffer& buffer = current ? *current : *lateBuffer ();
+    buffer.used = (size_t)(end - buffer.data);
+    if (!current)
+        buffer.flush ();
+    buffer.unlock ();
+}
+
+uint64_t cBinaryLog::now ()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now ().time_since_epoch ()).count () - logStart;
+}
+
+
+// reads from a log, every read is checked against the end
+class cLogReader
+{
+public:
+    cLogReader (const char* pos, const char* end) : pos (pos), end (end), ok (true)
+    {
+    }
+    template <typename T>
+    T get ()
+    {
+        T value = T ();
+        if ((size_t)(end - pos) < sizeof (T))
+        {
+            ok = false;
+            return value;
+        }
+        memcpy (&value, pos, sizeof (T));
+        pos += sizeof (T);
+        return value;
+    }
+    const char* skip (size_t len)
+    {
+        if ((size_t)(end - pos) < len)
+        {
+            ok = false;
+            return NULL;
+        }
+        pos += len;
+        return pos - len;
+    }
+
+    const char* pos;
+    const char* end;
+    bool ok;
+};
+
+typedef struct
+{
+    uint64_t    time;
+    uint32_t    thread;
+    uint32_t    id;
+    const char* message;
+    const char* end;
+}logEvent;
+
+typedef struct
+{
+    bool        defined;
+    std::string types;
+    std::string format;
+}logDefinition;
+
+// formats one message: "<seconds>.<nanoseconds> [T<thread>] <text>"
+static bool decodeMessage (const logEvent& event, const logDefinition& def, cFormatBuffer& out)
+{
+    cLogReader in (event.message, event.end);
+    char nanos[9];
+    uint64_t ns = event.time % 1000000000;
+    for (int n = 8; n >= 0; n--, ns /= 10)
+        nanos[n] = (char)('0' + ns % 10);
+    out.appendUnsigned (event.time / 1000000000);
+    out.append ('.');
+    out.append (nanos, sizeof (nanos));
+    out.append (" [T", 3);
+    out.appendUnsigned (event.thread);
+    out.append ("] ", 2);
+
+    const char* format = def.format.c_str ();
+    for (char type : def.types)
+    {
+        format = consoleFormat::appendLiteral (out, format);
+        switch (type)
+        {
+        case 'i':
+            out.appendSigned (in.get<int64_t> ());
+            break;
+        case 'u':
+            out.appendUnsigned (in.get<uint64_t> ());
+            break;
+        case 'f':
+            out.appendDouble (in.get<double> ());
+            break;
+        case 'p':
+            out.append ("0x", 2);
+            out.appendHex (in.get<uint64_t> ());
+            break;
+        case 'b':
+            consoleFormat::appendArg (out, in.get<char> () != 0);
+            break;
+        case 'c':
+            out.append (in.get<char> ());
+            break;
+        case 's':
+        {
+            uint32_t len = in.get<uint32_t> ();
+            const char* text = in.skip (len);
+            if (text)
+                out.append (text, len);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    consoleFormat::appendLiteral (out, format);
+    return in.ok && !out.error ();
+}
+
+bool cBinaryLog::decode (const char* data, size_t len, cConsoleSink& out)
+{
+    cLogReader in (data, data + len);
+    const char* magic = in.skip (8);
+    if (!magic || memcmp (magic, MAGIC, 8) || in.get<uint32_t> () != BYTE_ORDER_MARK || !in.skip (8))
+        return false;
+    const char* records = in.pos;
+
+    try
+    {
+        // definitions first, they are needed to find the end of a message
+        std::vector<logDefinition> defs;
+        while (in.ok && in.pos < in.end)
+        {
+            char kind = in.get<char> ();
+            if (kind == 'D')
+            {
+                uint32_t id = in.get<uint32_t> ();
+                in.get<uint8_t> ();
+                uint8_t count = in.get<uint8_t> ();
+                const char* types = in.skip (count);
+                uint32_t formatLen = in.get<uint32_t> ();
+                const char* format = in.skip (formatLen);
+                if (!in.ok || !id)
+                    return false;
+                if (defs.size () <= id)
+                    defs.resize ((size_t)id + 1);
+                defs[id].defined = true;
+                defs[id].types.assign (types, count);
+                defs[id].format.assign (format, formatLen);
+            }
+            else if (kind == 'C')
+            {
+                in.get<uint32_t> ();
+                in.skip (in.get<uint32_t> ());
+            }
+            else
+            {
+                return false;
+            }
+        }
+        if (!in.ok)
+            return false;
+
+        std::vector<logEvent> events;
+        in.pos = records;
+        while (in.pos < in.end)
+        {
+            if (in.get<char> () == 'D')
+            {
+                in.skip (5);
+                in.skip (in.get<uint8_t> ());
+                in.skip (in.get<uint32_t> ());
+                continue;
+            }
+            uint32_t thread = in.get<uint32_t> ();
+            uint32_t chunkLen = in.get<uint32_t> ();
+            const char* chunk = in.skip (chunkLen);
+            cLogReader messages (chunk, chunk + chunkLen);
+            while (messages.pos < messages.end)
+            {
+                logEvent event;
+                event.id      = messages.get<uint32_t> ();
+                event.time    = messages.get<uint64_t> ();
+                event.thread  = thread;
+                event.message = messages.pos;
+                if (!messages.ok || event.id >= defs.size () || !defs[event.id].defined)
+                    return false;
+                for (char type : defs[event.id].types)
+                {
+                    if (type == 'b' || type == 'c')
+                        messages.skip (1);
+                    else if (type == 's')
+                        messages.skip (messages.get<uint32_t> ());
+                    else
+                        messages.skip (8);
+                }
+                if (!messages.ok)
+                    return false;
+                event.end = messages.pos;
+                events.push_back (event);
+            }
+        }
+
+        // the chunks of the threads are in the order they were written, not in the order of the messages
+        std::stable_sort (events.begin (), events.end (), [](const logEvent& a, const logEvent& b)
+        {
+            return a.time < b.time;
+        });
+
+        cFormatBuffer text;
+        for (const logEvent& event : events)
+        {
+            if (!decodeMessage (event, defs[event.id], text))
+                return false;
+            if (text.length () >= 1024 * 1024)
+            {
+                if (!out.write (text.text (), text.length ()))
+                    return false;
+                text.clear ();
+            }
+        }
+        return out.write (text.text (), text.length ()) && out.flush ();
+    }
+    catch (const std::bad_alloc&)
+    {
+        Console::PrintError ("Not enough memory\n");
+        return false;
+    }
+}
+
+
+#ifdef WITH_UNITTESTS
+void cBinaryLog::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+#ifndef HAVE_WINDOWS
+    cMemorySink text;
+    BUG_IF_NOT (text.init (64 * 1024));
+    Console::SetSink (&text);
+    char out[64 * 1024];
+
+    // without a binary log, the messages are formatted right away; Normal is compiled in even with CONSOLE_MIN_LEVEL 3
+    for (int n = 0; n < 2; n++)
+        CONSOLE_LOG (Normal, "text {} {}\n", n, "mode");
+    BUG_IF_NOT (text.read (out, sizeof (out)) == 24 && !memcmp (out, "text 0 mode\ntext 1 mode\n", 24));
+
+    char path[] = "/tmp/cmdline-unittest-XXXXXX";
+    int fd = mkstemp (path);
+    BUG_IF_NOT (fd >= 0);
+    ::close (fd);
+    BUG_IF_NOT (open (path) && isOpen ());
+
+    const int THREADS = 4;
+    const int LINES = 10000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back ([t]()
+        {
+            std::string s ("string");
+            for (int n = 0; n < LINES; n++)
+                CONSOLE_LOG (Normal, "{} {} {} {} {} {} {{{}}}\n", t, n, (uint64_t)n * 3, n * 0.5, n % 2 == 0, 'c', s);
+            // only half of the threads write their buffer themselves, close does it for the others
+            if (t & 1)
+                flush ();
+        });
+    }
+    for (auto& thread : threads)
+        thread.join ();
+    const char* none = nullptr;
+    CONSOLE_LOG (Normal, "{} {} {}\n", none, (const void*)0x1234, std::string (MAX_STRING + 10, 'x'));
+    CONSOLE_LOG (Error, "no arguments\n");
+    close ();
+    BUG_IF_NOT (!isOpen ());
+    // nothing went to the console
+    BUG_IF_NOT (text.read (out, sizeof (out)) == 24);
+    Console::SetSink (nullptr);
+
+    cResponseFile file;
+    BUG_IF_NOT (file.open (path));
+    cMemorySink decoded;
+    BUG_IF_NOT (decoded.init (4 * 1024 * 1024));
+    BUG_IF_NOT (decode (file.begin (), (size_t)(file.end () - file.begin ()), decoded));
+    std::vector<char> all (4 * 1024 * 1024);
+    size_t len = decoded.read (all.data (), all.size ());
+    all.resize (len);
+    all.push_back ('\0');
+
+    // every message, in order of time and per thread in order of the calls
+    std::vector<int> next (THREADS, 0);
+    uint64_t last = 0;
+    int lines = 0;
+    for (char* line = all.data (); *line; lines++)
+    {
+        char* end = strchr (line, '\n');
+        BUG_IF_NOT (end);
+        *end = '\0';
+        unsigned long long sec, ns;
+        unsigned thread;
+        int consumed = 0;
+        BUG_IF_NOT (sscanf (line, "%llu.%9llu [T%u] %n", &sec, &ns, &thread, &consumed) == 3 && consumed);
+        uint64_t time = sec * 1000000000 + ns;
+        BUG_IF_NOT (time >= last);
+        last = time;
+        const char* message = line + consumed;
+        int t, n;
+        if (sscanf (message, "%d %d", &t, &n) == 2 && lines < THREADS * LINES)
+        {
+            char expected[128];
+            BUG_IF_NOT (t >= 0 && t < THREADS && n == next[t]);
+            snprintf (expected, sizeof (expected), "%d %d %llu %g %s c {string}", t, n, (unsigned long long)n * 3,
+                n * 0.5, n % 2 == 0 ? "true" : "false");
+            BUG_IF_NOT (!strcmp (message, expected));
+            next[t]++;
+        }
+        else if (lines == THREADS * LINES)
+        {
+            BUG_IF_NOT (!strncmp (message, "(null) 0x1234 xxx", 17) && strlen (message) == 14 + MAX_STRING);
+        }
+        else
+        {
+            BUG_IF_NOT (lines == THREADS * LINES + 1 && !strcmp (message, "no arguments"));
+        }
+        line = end + 1;
+    }
+    BUG_IF_NOT (lines == THREADS * LINES + 2);
+
+    // definitions are repeated in a new file, damaged files are rejected; non-const strings are strings as well
+    char mutableText[] = "non-const string";
+    char* mutableString = mutableText;
+    BUG_IF_NOT (binaryLog::argSize (mutableString) == 4 + strlen (mutableText));
+    BUG_IF_NOT (binaryLog::argSize (none) == 4 + 6);
+    BUG_IF_NOT (open (path));
+    CONSOLE_LOG (Error, "no arguments\n");
+    CONSOLE_LOG (Error, "{} {}\n", mutableString, none);
+    close ();
+    BUG_IF_NOT (file.open (path));
+    BUG_IF_NOT (decoded.init (1024));
+    BUG_IF_NOT (decode (file.begin (), (size_t)(file.end () - file.begin ()), decoded));
+    std::string decodedText (out, decoded.read (out, sizeof (out)));
+    BUG_IF_NOT (decodedText.find ("] no arguments\n") != std::string::npos);
+    const char* lastLine = "] non-const string (null)\n";
+    BUG_IF_NOT (decodedText.size () > strlen (lastLine) &&
+        !decodedText.compare (decodedText.size () - strlen (lastLine), strlen (lastLine), lastLine));
+    BUG_IF_NOT (!decode (file.begin (), (size_t)(file.end () - file.begin ()) - 1, decoded));
+    BUG_IF_NOT (!decode ("CMDBLOG2", 8, decoded));
+
+    // messages after the buffer of the thread is destroyed, as from atexit handlers of the main thread
+    BUG_IF_NOT (open (path));
+    std::thread late ([]()
+    {
+        struct cLateLog
+        {
+            ~cLateLog ()
+            {
+                CONSOLE_LOG (Normal, "late {}\n", 42);
+            }
+        };
+        static thread_local cLateLog lateLog;
+        (void)lateLog;
+        CONSOLE_LOG (Normal, "early\n");
+    });
+    late.join ();
+    close ();
+    BUG_IF_NOT (file.open (path));
+    BUG_IF_NOT (decoded.init (1024));
+    BUG_IF_NOT (decode (file.begin (), (size_t)(file.end () - file.begin ()), decoded));
+    decodedText.assign (out, decoded.read (out, sizeof (out)));
+    BUG_IF_NOT (decodedText.find ("] early\n") != std::string::npos && decodedText.find ("] late 42\n") != std::string::npos);
+    unlink (path);
+#endif
+}
+#endif
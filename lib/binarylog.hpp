@@ -0,0 +1,237 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BINARYLOG_HPP_
+#define BINARYLOG_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "consoleformat.hpp"
+
+class cConsoleSink;
+
+// Like CONSOLE_FORMAT, but while a binary log is open (see cBinaryLog) only the id of the call site, a timestamp
+// and the raw arguments are stored. The text is produced offline by cmdline-logdecode.
+#define CONSOLE_LOG(lvl, ...) \
+    do { if (Console::ShouldPrint (Console::lvl)) { static cBinaryLogSite consoleLogSite_; \
+        binaryLog::log<consoleFormat::placeholders (CONSOLE_FORMAT_STRING_ (__VA_ARGS__, 0))> ( \
+        consoleLogSite_, Console::lvl, __VA_ARGS__); } } while (0)
+
+// one CONSOLE_LOG statement; its id is assigned on first use
+struct cBinaryLogSite
+{
+    constexpr cBinaryLogSite () : id (0)
+    {
+    }
+    std::atomic<uint32_t> id;
+};
+
+// Binary log file. Each thread collects its messages in a buffer of its own, which is appended to the file in
+// one write when it is full, when the thread ends, on flush and on close. Strings are stored up to
+// MAX_STRING bytes. The file is read on a machine with the same byte order.
+//
+// File format: header, then records of two kinds in any order:
+//   definition: 'D', u32 id, u8 level, u8 argument count, argument types, u32 format length, format
+//   chunk:      'C', u32 thread, u32 length, messages
+// A message is u32 id, u64 nanoseconds since open, then the arguments in the order of the format. Types are
+// 'i' (i64), 'u' (u64), 'f' (double), 'p' (u64 pointer), 'b' and 'c' (u8), 's' (u32 length, bytes).
+class cBinaryLog
+{
+public:
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    static const size_t BUFFER_SIZE = 64 * 1024;
+    static const size_t MAX_STRING  = 4096;
+
+    // truncates 'path'; CONSOLE_LOG writes text to the console again after close
+    static bool open (const char* path);
+    // writes all buffers and closes the file; must not race with open
+    static void close ();
+    // writes the buffer of the calling thread
+    static void flush ();
+    static bool isOpen ()
+    {
+        return active.load (std::memory_order_acquire);
+    }
+
+    // writes the messages in 'data' as text, ordered by time; false if it is not a binary log or damaged
+    static bool decode (const char* data, size_t len, cConsoleSink& out);
+
+    // used by CONSOLE_LOG
+    static uint32_t define (cBinaryLogSite& site, int level, const char* format, const char* types);
+    static char* reserve (size_t len);
+    static void commit (char* end);
+    static uint64_t now ();
+
+private:
+    static std::atomic<bool> active;
+};
+
+
+namespace binaryLog
+{
+    template <typename T, typename Enable = void>
+    struct argType;
+    template <> struct argType<bool> { static const char tag = 'b'; };
+    template <> struct argType<char> { static const char tag = 'c'; };
+    template <> struct argType<float> { static const char tag = 'f'; };
+    template <> struct argType<double> { static const char tag = 'f'; };
+    template <> struct argType<const char*> { static const char tag = 's'; };
+    template <> struct argType<char*> { static const char tag = 's'; };
+    template <> struct argType<std::string> { static const char tag = 's'; };
+    template <typename T>
+    struct argType<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value &&
+        !std::is_same<T, char>::value>::type>
+    {
+        static const char tag = std::is_signed<T>::value ? 'i' : 'u';
+    };
+    template <typename T>
+    struct argType<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+    {
+        static const char tag = 'p';
+    };
+
+    // bytes needed for an argument
+    template <typename T>
+    size_t argSize (const T&)
+    {
+        return argType<T>::tag == 'b' || argType<T>::tag == 'c' ? 1 : 8;
+    }
+    inline size_t argSize (const char* value)
+    {
+        // NULL is written as "(null)"
+        size_t len = value ? strlen (value) : 6;
+        return 4 + (len < cBinaryLog::MAX_STRING ? len : cBinaryLog::MAX_STRING);
+    }
+    // without it, char* would be sized by the template above
+    inline size_t argSize (char* value)
+    {
+        return argSize ((const char*)value);
+    }
+    inline size_t argSize (const std::string& value)
+    {
+        return 4 + (value.size () < cBinaryLog::MAX_STRING ? value.size () : cBinaryLog::MAX_STRING);
+    }
+
+    inline char* putString (char* out, const char* value, size_t len)
+    {
+        uint32_t n = (uint32_t)(len < cBinaryLog::MAX_STRING ? len : cBinaryLog::MAX_STRING);
+        memcpy (out, &n, 4);
+        memcpy (out + 4, value, n);
+        return out + 4 + n;
+    }
+    inline char* put (char* out, bool value)
+    {
+        *out = value;
+        return out + 1;
+    }
+    inline char* put (char* out, char value)
+    {
+        *out = value;
+        return out + 1;
+    }
+    inline char* put (char* out, double value)
+    {
+        memcpy (out, &value, 8);
+        return out + 8;
+    }
+    inline char* put (char* out, const char* value)
+    {
+        return value ? putString (out, value, strlen (value)) : putString (out, "(null)", 6);
+    }
+    inline char* put (char* out, char* value)
+    {
+        return put (out, (const char*)value);
+    }
+    inline char* put (char* out, const std::string& value)
+    {
+        return putString (out, value.data (), value.size ());
+    }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value, char*>::type put (char* out, T value)
+    {
+        // sign extended for 'i', zero extended for 'u'
+        typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type v = value;
+        memcpy (out, &v, 8);
+        return out + 8;
+    }
+    template <typename T>
+    char* put (char* out, const T* value)
+    {
+        uint64_t v = (uintptr_t)value;
+        memcpy (out, &v, 8);
+        return out + 8;
+    }
+
+    inline char* putAll (char* out)
+    {
+        return out;
+    }
+    template <typename First, typename... Rest>
+    char* putAll (char* out, const First& first, const Rest&... rest)
+    {
+        return putAll (put (out, first), rest...);
+    }
+
+    inline size_t sizeAll ()
+    {
+        return 0;
+    }
+    template <typename First, typename... Rest>
+    size_t sizeAll (const First& first, const Rest&... rest)
+    {
+        return argSize (first) + sizeAll (rest...);
+    }
+
+    // use CONSOLE_LOG, it provides N
+    template <int N, typename... Args>
+    int log (cBinaryLogSite& site, Console::out_level lvl, const char* format, const Args&... args)
+    {
+        static_assert (N >= 0, "unmatched brace in format string, literal braces are written {{ and }}");
+        static_assert (N == sizeof... (Args), "number of arguments doesn't match the {} in the format string");
+        if (!cBinaryLog::isOpen ())
+            return consoleFormat::print<N> (lvl, format, args...);
+
+        uint32_t id = site.id.load (std::memory_order_acquire);
+        if (!id)
+        {
+            static const char types[] = {argType<typename std::decay<Args>::type>::tag..., '\0'};
+            id = cBinaryLog::define (site, lvl, format, types);
+            // without a definition decode would reject the whole log
+            if (!id)
+                return false;
+        }
+        char* out = cBinaryLog::reserve (12 + sizeAll (args...));
+        if (!out)
+            return false;
+        uint64_t time = cBinaryLog::now ();
+        memcpy (out, &id, 4);
+        memcpy (out + 4, &time, 8);
+        cBinaryLog::commit (putAll (out + 12, args...));
+        return true;
+    }
+}
+
+#endif /* BINARYLOG_HPP_ */
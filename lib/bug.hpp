@@ -31,8 +31,20 @@
 #endif
 
 
+// called by __game_over before it aborts, e.g. to write out buffered console output
+typedef void (*bugHook) ();
+inline bugHook& bugExitHook ()
+{
+    static bugHook hook = nullptr;
+    return hook;
+}
+
 static inline void __game_over (const char* expr, const char* file, int line)
 {
+    bugHook hook = bugExitHook ();
+    bugExitHook () = nullptr;
+    if (hook)
+        hook ();
     std::fprintf (stderr, "Oops, you may found a bug!!!\n %s %d: '%s'\n", file, line, expr);
     std::abort ();
 }
@@ -17,36 +17,101 @@
  */
 
 
+#include <cctype>
 #include <cstring>
 #include <cstdlib>
-#include <sstream>
-
-#include "ketopt.h"
+#include <new>
+#ifdef WITH_UNITTESTS
+#ifndef HAVE_WINDOWS
+#include <unistd.h>
+#endif
+#include <string>
+#include <thread>
+#endif
 
 #include "cmdline.hpp"
+#include "argconvert.hpp"
+#include "cmdlineparser.hpp"
+#include "longoptindex.hpp"
+#include "numberlist.hpp"
+#if defined (WITH_UNITTESTS) && __cplusplus >= 201703L
+#include "cmdlineschema.hpp"
+#endif
 
 #include "bug.hpp"
 #include "console.hpp"
 
 
-const int NO_SHORTNAME = 0x100;
+struct cCmdline::compiledOptions
+{
+    explicit compiledOptions (cArena* arena)
+    : shortopts (cArenaAllocator<char> (arena)), longopts (cArenaAllocator<ko_longopt_t> (arena)), longIndex (arena)
+    {
+    }
+
+    std::vector<char, cArenaAllocator<char> > shortopts;
+    std::vector<ko_longopt_t, cArenaAllocator<ko_longopt_t> > longopts;
+    cLongOptIndex longIndex;
+};
 
 
-cCmdline::cCmdline (int argc, char* argv[])
+static int lookupLongOption (const void* ctx, const ko_longopt_t*, const char* name, int len)
+{
+    return static_cast<const cLongOptIndex*>(ctx)->find (name, (size_t)len);
+}
+
+
+cCmdline::cCmdline (int argc, char* argv[], cArena* arena)
+: options (cArenaAllocator<argument> (arena)), dispatch (cArenaAllocator<int> (arena)), result (arena)
 {
     this->argc = argc;
     this->argv = argv;
+    this->arena = arena;
+    this->schema = NULL;
+    this->schemaDirty = true;
+    this->responseFiles = false;
+    this->inOrder = false;
+    this->helpWidth = 0;
+    this->dispatch.assign (NO_SHORTNAME, -1);
+}
+
+cCmdline::cCmdline (int argc, char* argv[])
+: cCmdline (argc, argv, NULL)
+{
 }
 
 cCmdline::cCmdline ()
+: cCmdline (0, NULL, NULL)
+{
+}
+
+cCmdline::cCmdline (cArena& arena)
+: cCmdline (0, NULL, &arena)
 {
-    this->argc = 0;
-    this->argv = NULL;
 }
 
 cCmdline::~cCmdline ()
 {
-    // TODO Auto-generated destructor stub
+    if (schema)
+    {
+        schema->~compiledOptions ();
+        cArenaAllocator<compiledOptions> (arena).deallocate (schema, 1);
+    }
+}
+
+
+bool cCmdline::reserve (size_t count)
+{
+    try
+    {
+        options.reserve (count);
+        dispatch.reserve (NO_SHORTNAME + count);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
+    }
+    return true;
 }
 
 
@@ -60,165 +125,761 @@ bool cCmdline::parse (int argc, char* argv[], int* optind)
 }
 
 
-bool cCmdline::parse (int* optind)
+void cCmdline::enableResponseFiles (bool enable)
 {
-    ketopt_t opt = KETOPT_INIT;
-    bool ret = true;
-    char* shortopts = new (std::nothrow) char[options.size() * 2 + 1];
-    char* pShort = shortopts;
-    if (!shortopts)
+    responseFiles = enable;
+}
+
+void cCmdline::stopAtPositional (bool enable)
+{
+    inOrder = enable;
+}
+
+int cCmdline::getArgc () const
+{
+    return result.expanded ? result.getArgc () : argc;
+}
+
+char** cCmdline::getArgv () const
+{
+    return result.expanded ? result.getArgv () : argv;
+}
+
+int cCmdline::indexOf (char shortname) const
+{
+    unsigned slot = dispatchSlot (shortname);
+    return shortname && slot < dispatch.size () ? dispatch[slot] : -1;
+}
+
+int cCmdline::indexOf (const char* longname) const
+{
+    for (size_t n = 0; n < options.size (); n++)
     {
-        Console::PrintError ("Not enough memory\n");
-        return false;
+        if (options[n].longname && !strcmp (options[n].longname, longname))
+            return (int)n;
+    }
+    return -1;
+}
+
+
+cCmdlineResult::cCmdlineResult (cArena* arena)
+: counts (cArenaAllocator<int> (arena)), values (cArenaAllocator<char*> (arena)),
+  numbers (cArenaAllocator<argValue> (arena)), listArgs (cArenaAllocator<listArg> (arena)),
+  items (cArenaAllocator<argItem> (arena)), lists (cArenaAllocator<argList> (arena)),
+  scratch (cArenaAllocator<uint64_t> (arena)), numberData (cArenaAllocator<uint64_t> (arena)),
+  numberLists (cArenaAllocator<argNumbers> (arena)), args (cArenaAllocator<char*> (arena)),
+  positionals (cArenaAllocator<char*> (arena)), responseFiles (cArenaAllocator<cResponseFile> (arena))
+{
+    expanded = false;
+    quiet    = false;
+    optind   = 0;
+    setError (CMDLINE_OK, -1, -1, NULL);
+}
+
+void cCmdlineResult::setError (cmdline_error kind, int argIndex, int option, const char* arg)
+{
+    error.kind     = kind;
+    error.argIndex = argIndex;
+    error.option   = option;
+    error.arg      = arg;
+}
+
+// scans the numbers of an ARG_UINT64_LIST or ARG_RANGE_SET argument into 'scratch'
+cmdline_error cCmdlineResult::scanNumbers (int option, char* arg, bool ranges)
+{
+    size_t len = strlen (arg);
+    size_t first = scratch.size ();
+    try
+    {
+        scratch.resize (first + cNumberList::capacity (len, ranges));
+    }
+    catch (const std::bad_alloc&)
+    {
+        return CMDLINE_NO_MEMORY;
     }
 
-    ko_longopt_t *longopts = new (std::nothrow) ko_longopt_t[options.size() + 1];
-    ko_longopt_t *pLong = longopts;
-    if (!longopts)
+    size_t count = 0;
+    cmdline_error e = cNumberList::scan (arg, len, ranges, scratch.data () + first, count);
+    for (size_t n = 0; ranges && e != CMDLINE_INVALID_ARGUMENT && n < count; n += 2)
     {
-        delete[] shortopts;
-        Console::PrintError ("Not enough memory\n");
+        if (scratch[first + n] > scratch[first + n + 1])
+            e = CMDLINE_INVALID_ARGUMENT;
+        else if (scratch[first + n + 1] >= cNumberList::RANGE_LIMIT)
+            e = CMDLINE_OUT_OF_RANGE;
+    }
+    if (e != CMDLINE_OK)
+    {
+        scratch.resize (first);
+        return e;
+    }
+    scratch.resize (first + count);
+
+    // there is at most one argument per token, the capacity is sufficient
+    listArg a = {option, arg, first, count};
+    listArgs.push_back (a);
+    return CMDLINE_OK;
+}
+
+// resets the result and copies argv, with expanded response files if requested
+bool cCmdlineResult::init (size_t options, int argc, char* const argv[], bool expandResponseFiles)
+{
+    args.clear ();
+    responseFiles.clear ();
+    expanded = false;
+    optind   = 0;
+    setError (CMDLINE_OK, -1, -1, NULL);
+
+    try
+    {
+        counts.assign (options, 0);
+        values.assign (options, NULL);
+        numbers.assign (options, argValue ());
+        argList empty = {NULL, 0};
+        lists.assign (options, empty);
+        argNumbers noNumbers = {NULL, 0};
+        numberLists.assign (options, noNumbers);
+        listArgs.clear ();
+        scratch.clear ();
+
+        int n = 0;
+        for (; n < argc && expandResponseFiles && strcmp (argv[n], "--"); n++)
+        {
+            if (n > 0 && argv[n][0] == '@' && argv[n][1])
+                break;
+        }
+        if (n >= argc || !expandResponseFiles || !strcmp (argv[n], "--"))
+        {
+            args.assign (argv, argv + argc);
+        }
+        else
+        {
+            expanded = true;
+            args.assign (argv, argv + n);
+            bool expand = true;
+            for (; n < argc; n++)
+            {
+                if (!strcmp (argv[n], "--"))
+                    expand = false;
+                if (!expand || argv[n][0] != '@' || !argv[n][1])
+                {
+                    args.push_back (argv[n]);
+                    continue;
+                }
+
+                responseFiles.emplace_back ();
+                cResponseFile& file = responseFiles.back ();
+                if (!file.open (argv[n] + 1))
+                {
+                    setError (CMDLINE_RESPONSE_FILE, n, -1, argv[n]);
+                    if (!quiet)
+                        Console::PrintError ("Cannot read response file `%s'.\n", argv[n] + 1);
+                    args.clear ();
+                    expanded = false;
+                    return false;
+                }
+                char* pos = file.begin ();
+                char* arg;
+                while ((arg = file.next (pos)) != NULL)
+                    args.push_back (arg);
+            }
+        }
+        args.push_back (NULL);
+
+        // afterwards the parser doesn't allocate anything
+        positionals.reserve (args.size ());
+        listArgs.reserve (args.size ());
+    }
+    catch (const std::bad_alloc&)
+    {
+        setError (CMDLINE_NO_MEMORY, -1, -1, NULL);
+        if (!quiet)
+            Console::PrintError ("Not enough memory\n");
+        args.clear ();
+        expanded = false;
         return false;
     }
+    return true;
+}
+
 
-    for (unsigned n = 0; n < options.size (); n++)
+// (re)builds the ketopt option tables, but only if options were added since the last call
+bool cCmdline::compile ()
+{
+    if (!schemaDirty)
+        return true;
+
+    try
     {
-        if (options.at (n).shortname < NO_SHORTNAME)
+        if (!schema)
         {
-            *pShort++ = (char)options.at (n).shortname;
-            if (options.at (n).hasArg)
+            cArenaAllocator<compiledOptions> alloc (arena);
+            compiledOptions* p = alloc.allocate (1);
+            try
+            {
+                schema = new (p) compiledOptions (arena);
+            }
+            catch (const std::bad_alloc&)
             {
-                *pShort++ = ':';
+                alloc.deallocate (p, 1);
+                throw;
             }
         }
-        if (options.at (n).longname)
+
+        auto& shortopts = schema->shortopts;
+        auto& longopts = schema->longopts;
+        cLongOptIndex& longIndex = schema->longIndex;
+        shortopts.clear ();
+        longopts.clear ();
+        longIndex.clear ();
+        shortopts.reserve (options.size() * 2 + 1);
+        longopts.reserve (options.size() + 1);
+        longIndex.reserve (options.size());
+
+        for (const auto &o : options)
         {
-            pLong->name    = (char*)options.at (n).longname;
-            pLong->has_arg = options.at (n).hasArg ? ko_required_argument : ko_no_argument;
-            if (options.at (n).hasOptionalArg && options.at (n).hasArg)
-                pLong->has_arg = ko_optional_argument;
-            pLong->val     = options.at (n).shortname;
-            pLong++;
+            if (o.shortname < NO_SHORTNAME)
+            {
+                shortopts.push_back ((char)o.shortname);
+                if (o.hasArg)
+                {
+                    shortopts.push_back (':');
+                }
+            }
+            if (o.longname)
+            {
+                ko_longopt_t l;
+                l.name    = o.longname;
+                l.has_arg = o.hasArg ? ko_required_argument : ko_no_argument;
+                if (o.hasOptionalArg && o.hasArg)
+                    l.has_arg = ko_optional_argument;
+                l.val     = o.shortname;
+                longIndex.add (o.longname, (int)longopts.size ());
+                longopts.push_back (l);
+            }
         }
+
+        ko_longopt_t end;
+        end.name    = NULL;
+        end.has_arg = 0;
+        end.val     = 0;
+        shortopts.push_back ('\0');
+        longopts.push_back (end);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
     }
 
-    *pShort        = '\0';
-    pLong->name    = NULL;
-    pLong->has_arg = 0;
-    pLong->val     = 0;
+    schemaDirty.store (false, std::memory_order_release);
+    return true;
+}
+
 
+bool cCmdline::parse (int argc, char* const argv[], cCmdlineResult& r) const
+{
+    return parseArgs (argc, argv, r, responseFiles);
+}
 
-    int result;
-    while ((result = ketopt (&opt, argc, argv, 1, shortopts, longopts)) >= 0 && ret)
+bool cCmdline::parseArgs (int argc, char* const argv[], cCmdlineResult& r, bool expandResponseFiles) const
+{
+    if (schemaDirty.load (std::memory_order_acquire))
     {
-        if (result == '?')
+        // only the first parse call after addOption compiles the option tables
+        std::lock_guard<std::mutex> lock (compileMtx);
+        if (schemaDirty && !const_cast<cCmdline*>(this)->compile ())
         {
-            Console::PrintError ("Unknown option `%s'.\n", opt.ind - 1 <= argc ? argv[opt.ind - 1] : "???");
-            ret = false;
+            r.setError (CMDLINE_NO_MEMORY, -1, -1, NULL);
+            if (!r.quiet)
+                Console::PrintError ("Not enough memory\n");
+            return false;
+        }
+    }
+
+    if (!r.init (options.size (), argc, argv, expandResponseFiles))
+        return false;
+
+    cmdlineTables tables;
+    tables.shortopts    = schema->shortopts.data ();
+    tables.longopts     = schema->longopts.data ();
+    tables.lookup       = lookupLongOption;
+    tables.lookupCtx    = &schema->longIndex;
+    tables.dispatch     = dispatch.data ();
+    tables.dispatchSize = dispatch.size ();
+    tables.inOrder      = inOrder;
+
+    bool ret = cmdlineParse (tables, r.getArgc (), r.getArgv (), r.positionals, r.optind, [this, &r](int option, char* arg)
+    {
+        r.counts[option]++;
+        if (!arg)
+            return CMDLINE_OK;
+        arg_type type = options[option].type;
+        cmdline_error e = CMDLINE_OK;
+        if (type == ARG_STRING_LIST || type == ARG_STRING_CSV)
+        {
+            // there is at most one argument per token, the capacity is sufficient
+            cCmdlineResult::listArg a = {option, arg, 0, 0};
+            r.listArgs.push_back (a);
         }
-        else if (result == ':')
+        else if (type == ARG_UINT64_LIST || type == ARG_RANGE_SET)
         {
-            Console::PrintError ("Option %s requires an argument.\n", opt.ind - 1 <= argc ? argv[opt.ind - 1] : "???");
-            ret = false;
+            e = r.scanNumbers (option, arg, type == ARG_RANGE_SET);
         }
         else
         {
-            int option = findOption (opt.opt);
-            if (option >= 0)
+            e = cArgConvert::convert (type, arg, r.numbers[option]);
+        }
+        if (e == CMDLINE_OK)
+            r.values[option] = arg;
+        return e;
+    }, r.error);
+    if (ret && !r.listArgs.empty () && !collectLists (r))
+    {
+        r.setError (CMDLINE_NO_MEMORY, -1, -1, NULL);
+        if (!r.quiet)
+            Console::PrintError ("Not enough memory\n");
+        return false;
+    }
+    if (!ret && !r.quiet)
+    {
+        const argument* o = r.error.option >= 0 ? &options[r.error.option] : NULL;
+        printParseError (r.error, o ? o->shortname : NO_SHORTNAME, o ? o->longname : NULL);
+    }
+
+    return checkMandatory (r) && ret;
+}
+
+// Groups the arguments of list options into one contiguous array, split at commas for ARG_STRING_CSV.
+// Numbers are grouped likewise, range sets are turned into bitsets.
+bool cCmdline::collectLists (cCmdlineResult& r) const
+{
+    // count the values per option to know where each option's values start
+    size_t total = 0;
+    size_t words = 0;
+    for (const auto& a : r.listArgs)
+    {
+        arg_type type = options[a.option].type;
+        if (type == ARG_UINT64_LIST || type == ARG_RANGE_SET)
+        {
+            argNumbers& l = r.numberLists[a.option];
+            size_t count = l.count;
+            if (type == ARG_UINT64_LIST)
+                l.count += a.count;
+            for (size_t n = 1; type == ARG_RANGE_SET && n < a.count; n += 2)
             {
-                argument &o = options.at (option);
-                if (o.hasArg && opt.arg)
-                {
-                    if (o.type == ARG_STRING)
-                        *((char**)o.arg) = opt.arg;
-                    if (o.type == ARG_INT)
-                        *((int*)o.arg) = (int)strtol (opt.arg, NULL, 0);
-                }
-                o.isSet++;
+                if (r.scratch[a.first + n] / 64 + 1 > l.count)
+                    l.count = (size_t)(r.scratch[a.first + n] / 64 + 1);
             }
-            else
+            words += l.count - count;
+            continue;
+        }
+
+        size_t count = 1;
+        if (type == ARG_STRING_CSV)
+        {
+            for (const char* c = a.arg; (c = strchr (c, ',')) != NULL; c++)
+                count++;
+        }
+        r.lists[a.option].count += count;
+        total += count;
+    }
+    try
+    {
+        r.items.resize (total);
+        // bitsets must be cleared
+        r.numberData.assign (words, 0);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
+    }
+
+    size_t start = 0;
+    for (auto& l : r.lists)
+    {
+        l.items = r.items.data () + start;
+        start  += l.count;
+        l.count = 0;
+    }
+    start = 0;
+    for (size_t n = 0; n < r.numberLists.size (); n++)
+    {
+        argNumbers& l = r.numberLists[n];
+        l.values = r.numberData.data () + start;
+        start   += l.count;
+        if (options[n].type == ARG_UINT64_LIST)
+            l.count = 0;
+    }
+
+    for (const auto& a : r.listArgs)
+    {
+        arg_type type = options[a.option].type;
+        if (type == ARG_UINT64_LIST || type == ARG_RANGE_SET)
+        {
+            argNumbers& l = r.numberLists[a.option];
+            uint64_t* values = const_cast<uint64_t*>(l.values);
+            if (type == ARG_UINT64_LIST)
             {
-                BUG ("getopt returned unexpected value");
+                memcpy (values + l.count, r.scratch.data () + a.first, a.count * sizeof (uint64_t));
+                l.count += a.count;
             }
+            for (size_t n = 0; type == ARG_RANGE_SET && n < a.count; n += 2)
+                cNumberList::setRange (values, r.scratch[a.first + n], r.scratch[a.first + n + 1]);
+            continue;
+        }
+
+        argList& l = r.lists[a.option];
+        argItem* item = const_cast<argItem*>(l.items) + l.count;
+        const char* str = a.arg;
+        const char* comma;
+        while (options[a.option].type == ARG_STRING_CSV && (comma = strchr (str, ',')) != NULL)
+        {
+            item->str = str;
+            item->len = (size_t)(comma - str);
+            item++;
+            l.count++;
+            str = comma + 1;
         }
+        item->str = str;
+        item->len = strlen (str);
+        l.count++;
     }
+    return true;
+}
 
+bool cCmdline::checkMandatory (cCmdlineResult& r) const
+{
     // first check whether options like --help or --version are set. If yes, we don't fail if mandatory options are missing
-    bool enforceMandatoryOptions = true;
-    for (const auto &currOpt : options)
+    for (size_t n = 0; n < options.size (); n++)
     {
-        if (currOpt.dontFailIfSet && currOpt.isSet)
-        {
-            enforceMandatoryOptions = false;
-            break;
-        }
+        if (options[n].dontFailIfSet && r.counts[n])
+            return true;
     }
-    for (const auto &currOpt : options)
+
+    bool ret = true;
+    for (size_t n = 0; n < options.size (); n++)
     {
-        // check if all mandatory options are present
-        if (enforceMandatoryOptions && !currOpt.optional && !currOpt.isSet)
+        if (!options[n].optional && !r.counts[n])
         {
-            Console::PrintError ("mandatory option -%c --%s not set\n", currOpt.shortname, currOpt.longname);
+            if (r.error.kind == CMDLINE_OK)
+                r.setError (CMDLINE_MISSING_OPTION, -1, (int)n, NULL);
             ret = false;
+            if (r.quiet)
+                break;
+            Console::PrintError ("mandatory option -%c --%s not set\n", options[n].shortname, options[n].longname);
         }
+    }
+    return ret;
+}
 
-        // return how often option was present
-        if (currOpt.pOptSet)
-            *(currOpt.pOptSet) = currOpt.isSet;
+bool cCmdline::parse (int* optind)
+{
+    bool ret = parse (argc, argv, result);
+
+    // permute the caller's argv, like getopt does
+    if (!result.expanded && result.getArgc () == argc)
+    {
+        for (int n = 0; n < argc; n++)
+            argv[n] = result.args[n];
     }
 
-    delete[] shortopts;
-    delete[] longopts;
+    for (size_t n = 0; n < options.size () && n < result.counts.size (); n++)
+    {
+        argument &o = options[n];
+        o.isSet = result.counts[n];
+        if (o.hasArg && o.arg && result.values[n])
+        {
+            const argValue& v = result.numbers[n];
+            switch (o.type)
+            {
+            case ARG_STRING:
+                *((char**)o.arg) = result.values[n];
+                break;
+            case ARG_INT:
+                *((int*)o.arg) = (int)v.i;
+                break;
+            case ARG_INT64:
+            case ARG_DURATION:
+                *((int64_t*)o.arg) = v.i;
+                break;
+            case ARG_UINT64:
+            case ARG_SIZE:
+                *((uint64_t*)o.arg) = v.u;
+                break;
+            case ARG_DOUBLE:
+                *((double*)o.arg) = v.d;
+                break;
+            case ARG_STRING_LIST:
+            case ARG_STRING_CSV:
+                *((argList*)o.arg) = result.lists[n];
+                break;
+            case ARG_UINT64_LIST:
+            case ARG_RANGE_SET:
+                *((argNumbers*)o.arg) = result.numberLists[n];
+                break;
+            default:
+                break;
+            }
+        }
+        // return how often option was present
+        if (o.pOptSet)
+            *(o.pOptSet) = o.isSet;
+    }
 
     if (optind)
-        *optind = opt.ind;
+        *optind = result.optind;
 
     return ret;
 }
 
+size_t cCmdline::helpColumns ()
+{
+    const size_t COL_MAX = 100;
+    const size_t COL_MIN = 40;
+
+    size_t columns = Console::TerminalWidth ();
+    if (!columns || columns > COL_MAX)
+        return COL_MAX;
+    return columns < COL_MIN ? COL_MIN : columns;
+}
+
+size_t cCmdline::descriptionColumn (size_t width)
+{
+    const size_t COL_DESC_START = 25;
+
+    // narrow terminals get more room for the descriptions
+    return width < 2 * COL_DESC_START ? width / 2 : COL_DESC_START;
+}
+
+const std::string& cCmdline::optionsHelp (size_t width)
+{
+    const size_t COL_OPT_START = 1;
+
+    if (!help.empty () && width == helpWidth)
+        return help;
+
+    size_t descStart = descriptionColumn (width);
+    size_t descWidth = width - descStart;
+
+    // the size is known up to the wrapping: one indent per description line
+    size_t size = 0;
+    for (const argument& o : options)
+    {
+        size += COL_OPT_START + sizeof ("-x, --") + (o.longname ? strlen (o.longname) : 0) + 1;
+        if (o.hasArg)
+            size += 2 * (strlen (o.argname) + sizeof (" <>"));
+        if (o.description)
+        {
+            size_t len = strlen (o.description);
+            size += len + (len / (descWidth / 2 + 1) + 1) * (descStart + 1);
+        }
+    }
+    // not valid before it is complete
+    helpWidth = 0;
+    help.clear ();
+    help.reserve (size);
+
+    for (const argument& o : options)
+    {
+        help.append (COL_OPT_START, ' ');
+        if (o.shortname < NO_SHORTNAME)
+        {
+            help += '-';
+            help += (char)o.shortname;
+            if (o.hasArg)
+                help.append (" <").append (o.argname).append (">");
+            if (o.longname)
+                help.append (", ");
+        }
+        if (o.longname)
+        {
+            help.append ("--").append (o.longname);
+            if (o.hasArg)
+                help.append (o.hasOptionalArg ? " [" : " <").append (o.argname).append (o.hasOptionalArg ? "]" : ">");
+        }
+        help += '\n';
+
+        if (o.description)
+            Console::WrapText (help, o.description, width, descStart, descStart);
+    }
+    helpWidth = width;
+    return help;
+}
+
 void cCmdline::printOptions ()
 {
-    const int COL_OPT_START = 1;
-    const int COL_DESC_START = 25;
-    const int COL_MAX = 100;
+    try
+    {
+        const std::string& text = optionsHelp (helpColumns ());
+        Console::Write (Console::Normal, text.data (), text.size ());
+    }
+    catch (const std::bad_alloc&)
+    {
+        Console::PrintError ("Not enough memory\n");
+    }
+}
+
 
-    for (unsigned n = 0; n < options.size (); n++)
+bool cCmdline::expectsArgument (const char* word) const
+{
+    if (word[0] != '-' || !word[1])
+        return false;
+    if (word[1] == '-')
     {
-        std::stringstream s;
-        s << std::string (COL_OPT_START, ' ');
-        if (options.at (n).shortname < NO_SHORTNAME)
+        // --name, unique abbreviations included; --name=ARG has its argument
+        const char* name = word + 2;
+        if (!*name || strchr (name, '='))
+            return false;
+        size_t len = strlen (name);
+        const argument* found = nullptr;
+        for (const argument& o : options)
         {
-            s << "-" << (char)options.at (n).shortname;
-            if (options.at (n).hasArg)
-                s << " <" << options.at (n).argname << ">";
-            if (options.at (n).longname)
-                s << ", ";
-            }
-        if (options.at (n).longname)
+            if (!o.longname || strncmp (o.longname, name, len))
+                continue;
+            if (!o.longname[len])
+                return o.hasArg && !o.hasOptionalArg;
+            if (found)
+                return false;
+            found = &o;
+        }
+        return found && found->hasArg && !found->hasOptionalArg;
+    }
+    // -abc: the first option with argument takes the rest of the word
+    for (const char* c = word + 1; *c; c++)
+    {
+        int index = dispatch[(unsigned char)*c];
+        if (index < 0)
+            return false;
+        if (options[index].hasArg)
+            return !c[1] && !options[index].hasOptionalArg;
+    }
+    return false;
+}
+
+void cCmdline::complete (int count, char* const words[], std::string& out) const
+{
+    if (count <= 0)
+        return;
+    // after "--" there are only positional arguments
+    for (int n = 0; n < count - 1; n++)
+    {
+        if (!strcmp (words[n], "--"))
+            return;
+    }
+    if (count >= 2 && expectsArgument (words[count - 2]))
+        return;
+
+    const char* word = words[count - 1];
+    if (word[0] != '-')
+        return;
+    if (!word[1])
+    {
+        for (const argument& o : options)
         {
-            s << "--" << options.at (n).longname;
-            if (options.at (n).hasArg)
+            if (o.shortname < NO_SHORTNAME)
             {
-                if (options.at (n).hasOptionalArg)
-                    s << " [" << options.at (n).argname << "]";
-                else
-                    s << " <" << options.at (n).argname << ">";
+                out += '-';
+                out += (char)o.shortname;
+                out += '\n';
             }
         }
-        Console::Print ("%s\n", s.str().c_str());
+    }
+    else if (word[1] != '-' || strchr (word, '='))
+    {
+        return;
+    }
+    size_t len = word[1] ? strlen (word + 2) : 0;
+    for (const argument& o : options)
+    {
+        if (o.longname && !strncmp (o.longname, word + 2, len))
+            out.append ("--").append (o.longname).append ("\n");
+    }
+}
+
+// text for a single quoted fish string: on one line, without markup
+static void appendFishText (std::string& out, const char* text)
+{
+    bool space = false;
+    bool first = true;
+    for (const char* p = text; *p; p++)
+    {
+        if (!strncmp (p, "</br>", 5))
+        {
+            p += 4;
+            space = true;
+        }
+        else if (*p == ' ' || (*p >= '\t' && *p <= '\r'))
+        {
+            space = true;
+        }
+        else
+        {
+            if (space && !first)
+                out += ' ';
+            space = false;
+            first = false;
+            if (*p == '\'' || *p == '\\')
+                out += '\\';
+            out += *p;
+        }
+    }
+}
+
+void cCmdline::completionScript (shell_type shell, const char* program, std::string& out) const
+{
+    // name of the shell function
+    std::string function ("_");
+    for (const char* p = program; *p; p++)
+        function += isalnum ((unsigned char)*p) ? *p : '_';
+    function += "_complete";
 
-        if (options.at (n).description)
+    switch (shell)
+    {
+    case SHELL_BASH:
+        out.append ("# bash completion for ").append (program).append (", add it to ~/.bashrc\n");
+        out.append (function).append (" ()\n"
+            "{\n"
+            "    local IFS=$'\\n'\n"
+            "    COMPREPLY=($(\"${COMP_WORDS[0]}\" --__complete \"${COMP_WORDS[@]:1:COMP_CWORD}\" 2>/dev/null))\n"
+            "}\n");
+        out.append ("complete -o bashdefault -o default -F ").append (function).append (" ").append (program).append ("\n");
+        break;
+    case SHELL_ZSH:
+        out.append ("# zsh completion for ").append (program).append (", add it to ~/.zshrc after compinit\n");
+        out.append (function).append (" ()\n"
+            "{\n"
+            "    local -a candidates\n"
+            "    candidates=(${(f)\"$(${words[1]} --__complete \"${(@)words[2,CURRENT]}\" 2>/dev/null)\"})\n"
+            "    if (( ${#candidates} )); then\n"
+            "        compadd -- $candidates\n"
+            "    else\n"
+            "        _files\n"
+            "    fi\n"
+            "}\n");
+        out.append ("compdef ").append (function).append (" ").append (program).append ("\n");
+        break;
+    case SHELL_FISH:
+        out.append ("# fish completion for ").append (program).append (", save it as ~/.config/fish/completions/")
+           .append (program).append (".fish\n");
+        for (const argument& o : options)
         {
-//            if (COL_DESC_START > s.str().size())
-//            {
-//                Console::PrintWrapedText (options.at (n).description, COL_MAX, COL_DESC_START - s.str().size() ,COL_DESC_START);
-//            }
-//            else
-//            {
-//               Console::Print ("\n");
-                 Console::PrintWrapedText (options.at (n).description, COL_MAX, COL_DESC_START, COL_DESC_START);
-//            }
+            out.append ("complete -c ").append (program);
+            if (o.shortname < NO_SHORTNAME)
+                out.append (" -s ").append (1, (char)o.shortname);
+            if (o.longname)
+                out.append (" -l ").append (o.longname);
+            if (o.hasArg && !o.hasOptionalArg)
+                out.append (" -r");
+            if (o.description)
+            {
+                out.append (" -d '");
+                appendFishText (out, o.description);
+                out += '\'';
+            }
+            out += '\n';
         }
+        break;
+    default:
+        BUG ("unknown shell");
     }
 }
 
@@ -239,12 +900,13 @@ bool cCmdline::addOption (bool optional, char shortname, const char* longname, c
             return false;
     }
 
+    int index = (int)options.size ();
     argument a;
     memset (&a, 0, sizeof (a));
 
     a.optional       = optional;
     a.pOptSet        = isOptionSet;
-    a.shortname      = shortname ? shortname : NO_SHORTNAME + (int)options.size();
+    a.shortname      = shortname ? shortname : NO_SHORTNAME + index;
     a.longname       = longname;
     a.description    = description;
     a.dontFailIfSet  = dontFailIfSet;
@@ -256,22 +918,28 @@ bool cCmdline::addOption (bool optional, char shortname, const char* longname, c
         a.arg            = arg;
         a.hasOptionalArg = hasOptionalArg;
     }
-    options.push_back (a);
+    unsigned slot = dispatchSlot (a.shortname);
+    try
+    {
+        options.push_back (a);
+        if (slot >= dispatch.size ())
+            dispatch.resize (slot + 1, -1);
+    }
+    catch (const std::bad_alloc&)
+    {
+        if (options.size () > (size_t)index)
+            options.pop_back ();
+        return false;
+    }
+    if (dispatch[slot] < 0)
+        dispatch[slot] = index;
+    schemaDirty = true;
+    help.clear ();
 
     return true;
 }
 
 
-int cCmdline::findOption (int shortname)
-{
-    for (unsigned n = 0; n < options.size (); n++)
-    {
-        if (options.at (n).shortname == shortname)
-            return n;
-    }
-    return -1;
-}
-
 #ifdef WITH_UNITTESTS
 void cCmdline::unitTest ()
 {
@@ -720,5 +1388,538 @@ void cCmdline::unitTest ()
         BUG_IF_NOT (isset1 == 1);
         BUG_IF_NOT (intarg1 == 2);
     }
+    {
+        // the same object parses several command lines; options added in between must be picked up
+        const char* argv1[] = {"unittest24", "-a", "-a"};
+        const char* argv2[] = {"unittest24", "-a", "--argb"};
+        isset1 = isset2 = -1;
+        int index = 0;
+
+        cCmdline obj;
+
+        BUG_IF_NOT (obj.addOption (true, 'a', "arga", "optional option without args", &isset1));
+
+        BUG_IF_NOT (obj.parse (3, (char**)argv1, &index));
+        BUG_IF_NOT (isset1 == 2);
+        BUG_IF_NOT (obj.parse (3, (char**)argv1, &index));
+        BUG_IF_NOT (isset1 == 2);
+        BUG_IF_NOT (!obj.parse (3, (char**)argv2, &index));
+
+        BUG_IF_NOT (obj.addOption (true, 'b', "argb", "optional option without args", &isset2));
+        BUG_IF_NOT (obj.parse (3, (char**)argv2, &index));
+        BUG_IF_NOT (isset1 == 1);
+        BUG_IF_NOT (isset2 == 1);
+        BUG_IF_NOT (index == 3);
+    }
+    {
+        // options are dispatched by short character and by synthetic long-only id
+        const char* argv[] = {"unittest25", "--argc", "-#", "-x", "--argd", "--arga", "--argd"};
+        int argc = 7;
+        isset1 = isset2 = isset3 = isset4 = -1;
+        int isset5 = -1;
+        int index = 0;
+
+        cCmdline obj(argc, (char**)argv);
+
+        BUG_IF_NOT (obj.addOption (true, 0, "arga", "optional long-only option without args", &isset1));
+        BUG_IF_NOT (obj.addOption (true, 'x', nullptr, "optional short-only option without args", &isset2));
+        BUG_IF_NOT (obj.addOption (true, 0, "argc", "optional long-only option without args", &isset3));
+        BUG_IF_NOT (obj.addOption (true, '#', nullptr, "optional short-only option without args", &isset4));
+        BUG_IF_NOT (obj.addOption (true, 0, "argd", "optional long-only option without args", &isset5));
+
+        BUG_IF_NOT (obj.parse (&index));
+        BUG_IF_NOT (isset1 == 1);
+        BUG_IF_NOT (isset2 == 1);
+        BUG_IF_NOT (isset3 == 1);
+        BUG_IF_NOT (isset4 == 1);
+        BUG_IF_NOT (isset5 == 2);
+        BUG_IF_NOT (index == 7);
+    }
+    {
+        // argv must be permuted exactly like ketopt does it (options first, then the remaining arguments)
+        const char* tokens[] = {"-a", "-b", "B", "-ab", "-abB", "--long", "--larg", "L", "--larg=L", "--", "x", "y", "-", "z"};
+        const int nTokens = sizeof (tokens) / sizeof (tokens[0]);
+        const ko_longopt_t longopts[] = {{(char*)"long", ko_no_argument, 'l'}, {(char*)"larg", ko_required_argument, 'L'}, {NULL, 0, 0}};
+        unsigned seed = 4711;
+
+        for (int run = 0; run < 500; run++)
+        {
+            const char* argv1[16];
+            const char* argv2[16];
+            int argc = 1 + run % 15;
+            argv1[0] = argv2[0] = "unittest26";
+            for (int n = 1; n < argc; n++)
+            {
+                seed = seed * 1103515245 + 12345;
+                argv1[n] = argv2[n] = tokens[(seed >> 16) % nTokens];
+            }
+
+            // an option requiring an argument may be the last token
+            ketopt_t s = KETOPT_INIT;
+            int result;
+            bool ok = true;
+            while (ok && (result = ketopt (&s, argc, (char**)argv1, 1, "ab:", longopts, NULL, NULL)) >= 0)
+            {
+                ok = result != '?' && result != ':';
+            }
+
+            int index = 0;
+            isset1 = isset2 = isset3 = isset4 = -1;
+            cCmdline obj(argc, (char**)argv2);
+            BUG_IF_NOT (obj.addOption (true, 'a', nullptr, "optional short-only option without args", &isset1));
+            BUG_IF_NOT (obj.addOption (true, 'b', nullptr, "optional short-only option with args", &isset2, "ARG", ARG_STRING, &stringarg1));
+            BUG_IF_NOT (obj.addOption (true, 0, "long", "optional long-only option without args", &isset3));
+            BUG_IF_NOT (obj.addOption (true, 0, "larg", "optional long-only option with args", &isset4, "ARG", ARG_STRING, &stringarg2));
+
+            BUG_IF_NOT (obj.parse (&index) == ok);
+            if (!ok)
+                continue;
+            BUG_IF_NOT (index == s.ind);
+            for (int n = 0; n < argc; n++)
+                BUG_IF_NOT (argv1[n] == argv2[n]);
+        }
+    }
+#if __cplusplus >= 201703L
+    {
+        static constexpr optionSpec specs[] = {
+            {true, 'a', "arga", "optional option with args", "ARG", ARG_INT},
+            {true, 'b', "argb", "optional option with args", "ARG", ARG_INT},
+            {true, 0, "argc", "optional long-only option with args", "ARG", ARG_STRING},
+            {false, 'd', "argd", "mandatory option with args", "ARG", ARG_STRING},
+            {true, 0, "arge", "optional long-only option with optional args", "ARG", ARG_STRING, true},
+            {true, 'v', nullptr, "optional short-only option without args"},
+            {true, 'h', "help", "help", nullptr, ARG_NO, false, true},
+        };
+        typedef cStaticCmdline<specs> schema;
+        static_assert (schema::indexOf ('b') == 1, "");
+        static_assert (schema::indexOf ("argc") == 2, "");
+        static_assert (schema::indexOf ('x') == schema::size, "");
+
+        {
+            const char* argv[] = {"unittest27", "ABCD", "--arga=0xa", "-vvb", "10", "--argc=CCC", "EFGH", "--ar", "--argd", "DDD", "--arge"};
+            schema::result r;
+            int index = 0;
+
+            BUG_IF_NOT (!schema::parse (11, (char**)argv, r, &index)); // --ar is ambiguous
+        }
+        {
+            const char* argv[] = {"unittest27", "ABCD", "--arga=0xa", "-vvb", "10", "--argc=CCC", "EFGH", "--argd", "DDD", "--arge"};
+            schema::result r;
+            int index = 0;
+
+            BUG_IF_NOT (schema::parse (10, (char**)argv, r, &index));
+            BUG_IF_NOT (r.isSet[schema::indexOf ('a')] == 1);
+            BUG_IF_NOT (r.intArg[schema::indexOf ('a')] == 10);
+            BUG_IF_NOT (r.intArg[schema::indexOf ('b')] == 10);
+            BUG_IF_NOT (!strcmp (r.strArg[schema::indexOf ("argc")], "CCC"));
+            BUG_IF_NOT (!strcmp (r.strArg[schema::indexOf ('d')], "DDD"));
+            BUG_IF_NOT (r.isSet[schema::indexOf ("arge")] == 1);
+            BUG_IF_NOT (!r.strArg[schema::indexOf ("arge")]);
+            BUG_IF_NOT (r.isSet[schema::indexOf ('v')] == 2);
+            BUG_IF_NOT (r.isSet[schema::indexOf ('h')] == 0);
+            BUG_IF_NOT (index == 8);
+            BUG_IF_NOT (!strcmp (argv[8], "ABCD"));
+            BUG_IF_NOT (!strcmp (argv[9], "EFGH"));
+        }
+        {
+            // abbreviations, and a missing mandatory option is ok if --help is given
+            const char* argv[] = {"unittest28", "--argc", "CCC", "--he", "--arge=EEE"};
+            schema::result r;
+
+            BUG_IF_NOT (schema::parse (5, (char**)argv, r));
+            BUG_IF_NOT (!strcmp (r.strArg[schema::indexOf ("argc")], "CCC"));
+            BUG_IF_NOT (!strcmp (r.strArg[schema::indexOf ("arge")], "EEE"));
+            BUG_IF_NOT (r.isSet[schema::indexOf ('h')] == 1);
+        }
+        {
+            const char* argv[] = {"unittest29", "--argc", "CCC", "--argx"};
+            schema::result r;
+
+            BUG_IF_NOT (!schema::parse (3, (char**)argv, r)); // -d is missing
+            BUG_IF_NOT (!schema::parse (4, (char**)argv, r)); // --argx is unknown
+        }
+    }
+#endif
+#ifndef HAVE_WINDOWS
+    {
+        // response files
+        char path[] = "/tmp/cmdline-unittest-XXXXXX";
+        int fd = mkstemp (path);
+        BUG_IF_NOT (fd >= 0);
+        const char content[] = "-b \"A A\"\n--argc=C XYZ\n";
+        BUG_IF_NOT (write (fd, content, sizeof (content) - 1) == (ssize_t)sizeof (content) - 1);
+        close (fd);
+
+        std::string at = std::string ("@") + path;
+        const char* argv[] = {"unittest30", "ABCD", at.c_str (), "-a", "--", at.c_str ()};
+        int argc = 6;
+        isset1 = isset2 = isset3 = -1;
+        stringarg1 = stringarg2 = NULL;
+        int index = 0;
+
+        cCmdline obj(argc, (char**)argv);
+        BUG_IF_NOT (obj.addOption (true, 'a', "arga", "optional option without args", &isset1));
+        BUG_IF_NOT (obj.addOption (true, 'b', "argb", "optional option with args", &isset2, "ARG", ARG_STRING, &stringarg1));
+        BUG_IF_NOT (obj.addOption (true, 'c', "argc", "optional option with args", &isset3, "ARG", ARG_STRING, &stringarg2));
+
+        // disabled by default
+        const char* argvCopy[] = {"unittest30", "ABCD", at.c_str (), "-a", "--", at.c_str ()};
+        BUG_IF_NOT (obj.parse (argc, (char**)argvCopy, &index));
+        BUG_IF_NOT (obj.getArgc () == argc && obj.getArgv () == (char**)argvCopy);
+        BUG_IF_NOT (isset2 == 0);
+
+        obj.enableResponseFiles ();
+        BUG_IF_NOT (obj.parse (argc, (char**)argv, &index));
+        BUG_IF_NOT (isset1 == 1 && isset2 == 1 && isset3 == 1);
+        BUG_IF_NOT (!strcmp (stringarg1, "A A"));
+        BUG_IF_NOT (!strcmp (stringarg2, "C"));
+        BUG_IF_NOT (obj.getArgc () == 9);
+        char** expanded = obj.getArgv ();
+        BUG_IF_NOT (index == 6);
+        BUG_IF_NOT (!strcmp (expanded[5], "--"));
+        BUG_IF_NOT (!strcmp (expanded[6], "ABCD"));
+        BUG_IF_NOT (!strcmp (expanded[7], "XYZ"));
+        BUG_IF_NOT (!strcmp (expanded[8], at.c_str ())); // after "--"
+        BUG_IF_NOT (!expanded[9]);
+
+        unlink (path);
+        const char* argvMissing[] = {"unittest30", at.c_str ()};
+        BUG_IF_NOT (!obj.parse (2, (char**)argvMissing, &index));
+    }
+#endif
+    {
+        // one schema, several threads with their own results; argv is not modified
+        cCmdline obj;
+        BUG_IF_NOT (obj.addOption (false, 'a', "arga", "mandatory option with args", nullptr, "ARG", ARG_STRING, nullptr));
+        BUG_IF_NOT (obj.addOption (true, 0, "argb", "optional long-only option with args", nullptr, "ARG", ARG_INT, nullptr));
+        BUG_IF_NOT (obj.addOption (true, 'v', nullptr, "optional short-only option without args", nullptr));
+        BUG_IF_NOT (obj.indexOf ('a') == 0 && obj.indexOf ("arga") == 0);
+        BUG_IF_NOT (obj.indexOf ("argb") == 1 && obj.indexOf ('v') == 2);
+        BUG_IF_NOT (obj.indexOf ('b') == -1 && obj.indexOf ("argc") == -1 && obj.indexOf ((char)0) == -1);
+
+        const int THREADS = 8;
+        bool ok[THREADS];
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++)
+        {
+            threads.emplace_back ([&obj, &ok, t]()
+            {
+                ok[t] = true;
+                cCmdlineResult r;
+                for (int n = 0; n < 1000; n++)
+                {
+                    std::string a = std::to_string (t) + "/" + std::to_string (n);
+                    std::string b = "--argb=" + std::to_string (n);
+                    const char* argv[] = {"unittest31", "POS", "-a", a.c_str (), b.c_str (), "-vv", "-v", "POS2"};
+                    const char* copy[8];
+                    memcpy (copy, argv, sizeof (argv));
+
+                    ok[t] = ok[t] && obj.parse (8, (char* const*)argv, r);
+                    ok[t] = ok[t] && !memcmp (copy, argv, sizeof (argv));
+                    ok[t] = ok[t] && r.isSet (0) == 1 && !strcmp (r.getArg (0), a.c_str ());
+                    ok[t] = ok[t] && r.isSet (1) == 1 && !strcmp (r.getArg (1), b.c_str () + 7);
+                    ok[t] = ok[t] && r.isSet (2) == 3 && !r.getArg (2);
+                    ok[t] = ok[t] && r.getArgc () == 8 && r.getOptind () == 6;
+                    ok[t] = ok[t] && !strcmp (r.getArgv ()[6], "POS") && !strcmp (r.getArgv ()[7], "POS2");
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join ();
+        for (int t = 0; t < THREADS; t++)
+            BUG_IF_NOT (ok[t]);
+
+        cCmdlineResult r;
+        const char* argv[] = {"unittest31", "-v"};
+        BUG_IF_NOT (!obj.parse (2, (char* const*)argv, r)); // -a is missing
+        BUG_IF_NOT (r.isSet (2) == 1);
+        BUG_IF_NOT (r.getError ().kind == CMDLINE_MISSING_OPTION && r.getError ().option == 0);
+        BUG_IF_NOT (r.getError ().argIndex == -1 && !r.getError ().arg);
+
+        // errors are stored, but not printed
+        r.setQuiet ();
+        const char* argv2[] = {"unittest31", "-a", "x", "--argb"};
+        BUG_IF_NOT (!obj.parse (4, (char* const*)argv2, r));
+        BUG_IF_NOT (r.getError ().kind == CMDLINE_MISSING_ARGUMENT && r.getError ().option == 1);
+        BUG_IF_NOT (r.getError ().argIndex == 3 && !strcmp (r.getError ().arg, "--argb"));
+        const char* argv3[] = {"unittest31", "x", "-va", "x", "-vw"};
+        BUG_IF_NOT (!obj.parse (5, (char* const*)argv3, r));
+        BUG_IF_NOT (r.getError ().kind == CMDLINE_UNKNOWN_OPTION && r.getError ().option == -1);
+        BUG_IF_NOT (r.getError ().argIndex == 4 && !strcmp (r.getError ().arg, "-vw"));
+        BUG_IF_NOT (obj.parse (3, (char* const*)argv3 + 1, r));
+        BUG_IF_NOT (r.getError ().kind == CMDLINE_OK);
+    }
+    {
+        // numeric arguments are converted strictly
+        int i = 0;
+        int64_t i64 = 0, duration = 0;
+        uint64_t u64 = 0, size = 0;
+        double d = 0;
+        cCmdline obj;
+        BUG_IF_NOT (obj.addOption (true, 'i', "int", "int", nullptr, "N", ARG_INT, &i));
+        BUG_IF_NOT (obj.addOption (true, 0, "int64", "int64", nullptr, "N", ARG_INT64, &i64));
+        BUG_IF_NOT (obj.addOption (true, 0, "uint64", "uint64", nullptr, "N", ARG_UINT64, &u64));
+        BUG_IF_NOT (obj.addOption (true, 'd', "double", "double", nullptr, "N", ARG_DOUBLE, &d));
+        BUG_IF_NOT (obj.addOption (true, 's', "size", "size", nullptr, "N", ARG_SIZE, &size));
+        BUG_IF_NOT (obj.addOption (true, 't', "timeout", "duration", nullptr, "N", ARG_DURATION, &duration));
+
+        char* argv[] = {"unittest32", "-i", "-17", "--int64=-9000000000", "--uint64", "0xffffffffffffffff", "-d2.5",
+            "--size=4G", "-t", "1h30m", NULL};
+        BUG_IF_NOT (obj.parse (10, argv));
+        BUG_IF_NOT (i == -17 && i64 == -9000000000LL && u64 == UINT64_MAX && d == 2.5);
+        BUG_IF_NOT (size == 4ULL << 30 && duration == 5400 * 1000000000LL);
+
+        cCmdlineResult r;
+        r.setQuiet ();
+        const char* argv2[] = {"unittest32", "-s", "64k", "-t250ms", "--size", "1T"};
+        BUG_IF_NOT (obj.parse (6, (char* const*)argv2, r));
+        BUG_IF_NOT (r.getUnsigned (4) == 1ULL << 40 && r.getInt (5) == 250000000);
+        BUG_IF_NOT (!strcmp (r.getArg (4), "1T"));
+
+        const char* argv3[] = {"unittest32", "pos", "-i", "1", "-i", "2147483648"};
+        BUG_IF_NOT (!obj.parse (6, (char* const*)argv3, r));
+        BUG_IF_NOT (r.getError ().kind == CMDLINE_OUT_OF_RANGE && r.getError ().option == 0);
+        BUG_IF_NOT (r.getError ().argIndex == 4 && !strcmp (r.getError ().arg, "2147483648"));
+
+        const char* argv4[] = {"unittest32", "--double=1,5"};
+        BUG_IF_NOT (!obj.parse (2, (char* const*)argv4, r));
+        BUG_IF_NOT (r.getError ().kind == CMDLINE_INVALID_ARGUMENT && r.getError ().option == 3);
+        BUG_IF_NOT (r.getError ().argIndex == 1 && !strcmp (r.getError ().arg, "1,5"));
+
+        // the variables keep their values if parsing fails
+        char* argv5[] = {"unittest32", "--int", "12abc", NULL};
+        BUG_IF_NOT (!obj.parse (3, argv5));
+        BUG_IF_NOT (i == -17);
+    }
+    {
+        // list options collect all occurrences
+        argList include = {NULL, 0}, tags = {NULL, 0};
+        const char* last = NULL;
+        cCmdline obj;
+        BUG_IF_NOT (obj.addOption (true, 'I', "include", "include", nullptr, "DIR", ARG_STRING_LIST, &include));
+        BUG_IF_NOT (obj.addOption (true, 't', "tag", "tags", nullptr, "TAG,...", ARG_STRING_CSV, &tags));
+        BUG_IF_NOT (obj.addOption (true, 's', "string", "string", nullptr, "S", ARG_STRING, &last));
+
+        char* argv[] = {"unittest34", "-Ia", "--tag=x,y", "-s1", "pos", "--include", "b,c", "-t", "z,,", "-s2",
+            "-Id", "-t", "", NULL};
+        for (int n = 0; n < 2; n++)
+        {
+            BUG_IF_NOT (obj.parse (13, argv));
+            BUG_IF_NOT (include.count == 3 && !strcmp (last, "2"));
+            BUG_IF_NOT (include.items[0].len == 1 && !strncmp (include.items[0].str, "a", 1));
+            BUG_IF_NOT (include.items[1].len == 3 && !strncmp (include.items[1].str, "b,c", 3));
+            BUG_IF_NOT (include.items[2].len == 1 && !strncmp (include.items[2].str, "d", 1));
+            BUG_IF_NOT (tags.count == 6);
+            const char* expected[] = {"x", "y", "z", "", "", ""};
+            for (size_t k = 0; k < 6; k++)
+            {
+                BUG_IF_NOT (tags.items[k].len == strlen (expected[k]));
+                BUG_IF_NOT (!strncmp (tags.items[k].str, expected[k], tags.items[k].len));
+            }
+            // all values are in one array
+            BUG_IF_NOT (include.items + include.count == tags.items);
+        }
+
+        cCmdlineResult r;
+        const char* argv2[] = {"unittest34", "-s", "x"};
+        BUG_IF_NOT (obj.parse (3, (char* const*)argv2, r));
+        BUG_IF_NOT (r.getList (0).count == 0 && r.getList (1).count == 0);
+        const char* argv3[] = {"unittest34", "-t", "a,b", "-It", "-t", "c"};
+        BUG_IF_NOT (obj.parse (6, (char* const*)argv3, r));
+        BUG_IF_NOT (r.getList (0).count == 1 && r.getList (1).count == 3);
+        BUG_IF_NOT (!strncmp (r.getList (1).items[2].str, "c", 1) && !strcmp (r.getArg (1), "c"));
+    }
+    {
+        // numeric lists and range sets
+        argNumbers ids = {NULL, 0}, cpus = {NULL, 0};
+        cCmdline obj;
+        BUG_IF_NOT (obj.addOption (true, 0, "ids", "ids", nullptr, "ID,...", ARG_UINT64_LIST, &ids));
+        BUG_IF_NOT (obj.addOption (true, 'c', "cpus", "cpus", nullptr, "CPU,...", ARG_RANGE_SET, &cpus));
+
+        char* argv[] = {"unittest35", "--ids=17,42", "-c", "0-63,128-191", "--ids", "7", "-c70,65", NULL};
+        for (int n = 0; n < 2; n++)
+        {
+            BUG_IF_NOT (obj.parse (7, argv));
+            BUG_IF_NOT (ids.count == 3 && ids.values[0] == 17 && ids.values[1] == 42 && ids.values[2] == 7);
+            BUG_IF_NOT (cpus.count == 3);
+            BUG_IF_NOT (cpus.values[0] == ~0ULL && cpus.values[1] == ((1ULL << 6) | (1ULL << 1)) && cpus.values[2] == ~0ULL);
+        }
+
+        cCmdlineResult r;
+        r.setQuiet ();
+        const char* argv2[] = {"unittest35", "--cpus=3"};
+        BUG_IF_NOT (obj.parse (2, (char* const*)argv2, r));
+        BUG_IF_NOT (r.getNumbers (0).count == 0 && r.getNumbers (1).count == 1 && r.getNumbers (1).values[0] == 8);
+        const char* argv3[] = {"unittest35", "--cpus=5-3"};
+        BUG_IF_NOT (!obj.parse (2, (char* const*)argv3, r));
+        BUG_IF_NOT (r.getError ().kind == CMDLINE_INVALID_ARGUMENT && r.getError ().option == 1);
+        const char* argv4[] = {"unittest35", "--cpus=0-16777216"};
+        BUG_IF_NOT (!obj.parse (2, (char* const*)argv4, r));
+        BUG_IF_NOT (r.getError ().kind == CMDLINE_OUT_OF_RANGE);
+        const char* argv5[] = {"unittest35", "--ids=1,2", "--ids=1,,2"};
+        BUG_IF_NOT (!obj.parse (3, (char* const*)argv5, r));
+        BUG_IF_NOT (r.getError ().kind == CMDLINE_INVALID_ARGUMENT && r.getError ().argIndex == 2);
+    }
+#if __cplusplus >= 201703L
+    {
+        static constexpr optionSpec specs[] = {
+            {true, 's', "size", "size", "N", ARG_SIZE},
+            {true, 'i', "int", "int", "N", ARG_INT}
+        };
+        typedef cStaticCmdline<specs> cmdline;
+        cmdline::result r;
+        char* argv[] = {"unittest33", "-s", "2M", "-i0x10", NULL};
+        BUG_IF_NOT (cmdline::parse (4, argv, r));
+        BUG_IF_NOT (r.value[0].u == 2ULL << 20 && r.intArg[1] == 16 && r.value[1].i == 16);
+        char* argv2[] = {"unittest33", "-s", "2X", NULL};
+        BUG_IF_NOT (!cmdline::parse (3, argv2, r));
+    }
+#endif
+    {
+        // the long option index must give the same answers as ketopt's linear scan
+        const char* names[] = {"verbose", "version", "ver", "help", "helper", "x", "dup", "dup", "a-b", "a-bc", "zzz", NULL};
+
+        cLongOptIndex index;
+        ko_longopt_t longopts[sizeof (names) / sizeof (names[0])];
+        for (int n = 0; names[n]; n++)
+        {
+            index.add (names[n], n);
+            longopts[n].name = (char*)names[n];
+            longopts[n].has_arg = ko_no_argument;
+            longopts[n].val = n;
+        }
+        longopts[sizeof (names) / sizeof (names[0]) - 1].name = NULL;
+
+        // every prefix of every name, plus some names that don't exist
+        const char* queries[] = {"", "v", "ve", "ver", "verb", "verbose", "verbosex", "vers", "version", "h", "help",
+                "helpe", "helper", "helpers", "x", "xx", "d", "du", "dup", "a", "a-", "a-b", "a-bc", "z", "zz", "zzz",
+                "q", "-", "=", NULL};
+        for (int n = 0; queries[n]; n++)
+        {
+            size_t len = strlen (queries[n]);
+            BUG_IF_NOT (index.find (queries[n], len) == ko_longopt_scan (NULL, longopts, queries[n], (int)len));
+        }
+
+        BUG_IF_NOT (index.find ("verbose=2", 7) == 0);
+        BUG_IF_NOT (index.find ("ver", 3) == 2);
+        BUG_IF_NOT (index.find ("verb", 4) == 0);
+        BUG_IF_NOT (index.find ("vers", 4) == 1);
+        BUG_IF_NOT (index.find ("dup", 3) == cLongOptIndex::AMBIGUOUS);
+        BUG_IF_NOT (index.find ("he", 2) == cLongOptIndex::AMBIGUOUS);
+        BUG_IF_NOT (index.find ("q", 1) == cLongOptIndex::NOT_FOUND);
+
+        // empty index
+        index.clear ();
+        BUG_IF_NOT (index.find ("", 0) == cLongOptIndex::NOT_FOUND);
+        BUG_IF_NOT (index.find ("a", 1) == cLongOptIndex::NOT_FOUND);
+
+        // a single option can be abbreviated down to an empty name, just like with ketopt
+        index.add ("only", 42);
+        BUG_IF_NOT (index.find ("", 0) == 42);
+    }
+    {
+        // help text layout, cached per width until options are added
+        int isSet;
+        const char* arg;
+        cCmdline obj;
+        BUG_IF_NOT (obj.addOption (true, 'a', "arga", "first option", &isSet, "ARG", ARG_STRING, &arg));
+        BUG_IF_NOT (obj.addOption (true, 0, "argb", "optional argument", &isSet, "N", ARG_STRING, &arg, true));
+        BUG_IF_NOT (obj.addOption (true, 'c', nullptr, "short only with a description that needs two lines", &isSet));
+
+        const std::string& wide = obj.optionsHelp (100);
+        BUG_IF_NOT (wide ==
+            " -a <ARG>, --arga <ARG>\n"
+            "                         first option\n"
+            " --argb [N]\n"
+            "                         optional argument\n"
+            " -c\n"
+            "                         short only with a description that needs two lines\n");
+        const char* data = wide.data ();
+        BUG_IF_NOT (obj.optionsHelp (100).data () == data);
+
+        BUG_IF_NOT (obj.optionsHelp (40) ==
+            " -a <ARG>, --arga <ARG>\n"
+            "                    first option\n"
+            " --argb [N]\n"
+            "                    optional argument\n"
+            " -c\n"
+            "                    short only with a\n"
+            "                    description that\n"
+            "                    needs two lines\n");
+
+        BUG_IF_NOT (obj.addOption (true, 'd', nullptr, nullptr, &isSet));
+        BUG_IF_NOT (obj.optionsHelp (40).find (" -d\n") != std::string::npos);
+        BUG_IF_NOT (helpColumns () >= 40 && helpColumns () <= 100);
+    }
+    {
+        // options end at the first positional argument
+        int a, b, index;
+        const char* argv[] = {"unittest", "-a", "cmd", "-b", "x", NULL};
+        cCmdline obj;
+        BUG_IF_NOT (obj.addOption (true, 'a', nullptr, "a", &a));
+        BUG_IF_NOT (obj.addOption (true, 'b', nullptr, "b", &b));
+        obj.stopAtPositional ();
+        BUG_IF_NOT (obj.parse (5, (char**)argv, &index));
+        BUG_IF_NOT (a == 1 && b == 0 && index == 2);
+        BUG_IF_NOT (!strcmp (argv[2], "cmd") && !strcmp (argv[3], "-b") && !strcmp (argv[4], "x"));
+        obj.stopAtPositional (false);
+        BUG_IF_NOT (obj.parse (5, (char**)argv, &index));
+        BUG_IF_NOT (a == 1 && b == 1 && index == 3);
+        BUG_IF_NOT (!strcmp (argv[2], "-b") && !strcmp (argv[3], "cmd"));
+    }
+    {
+        // completion
+        int isSet;
+        const char* arg;
+        cCmdline obj;
+        BUG_IF_NOT (obj.addOption (true, 'a', "arga", "it's \\ </br> two  lines", &isSet, "ARG", ARG_STRING, &arg));
+        BUG_IF_NOT (obj.addOption (true, 0, "argb", "optional argument", &isSet, "N", ARG_STRING, &arg, true));
+        BUG_IF_NOT (obj.addOption (true, 'c', "other", nullptr, &isSet));
+
+        auto complete = [&obj](std::vector<const char*> words)
+        {
+            std::string out;
+            obj.complete ((int)words.size (), (char* const*)words.data (), out);
+            return out;
+        };
+        BUG_IF_NOT (complete ({}) == "");
+        BUG_IF_NOT (complete ({""}) == "");
+        BUG_IF_NOT (complete ({"-"}) == "-a\n-c\n--arga\n--argb\n--other\n");
+        BUG_IF_NOT (complete ({"--"}) == "--arga\n--argb\n--other\n");
+        BUG_IF_NOT (complete ({"--ar"}) == "--arga\n--argb\n");
+        BUG_IF_NOT (complete ({"--argb"}) == "--argb\n");
+        BUG_IF_NOT (complete ({"--x"}) == "");
+        BUG_IF_NOT (complete ({"--arga="}) == "");
+        BUG_IF_NOT (complete ({"-c"}) == "");
+        BUG_IF_NOT (complete ({"pos", "--o"}) == "--other\n");
+        // option arguments
+        BUG_IF_NOT (complete ({"-a", "--o"}) == "");
+        BUG_IF_NOT (complete ({"-ca", "--o"}) == "");
+        BUG_IF_NOT (complete ({"--arga", "--o"}) == "");
+        BUG_IF_NOT (complete ({"--arg", "--o"}) == "--other\n"); // ambiguous
+        BUG_IF_NOT (complete ({"--oth", "--o"}) == "--other\n");
+        BUG_IF_NOT (complete ({"-aX", "--o"}) == "--other\n");
+        BUG_IF_NOT (complete ({"--arga=X", "--o"}) == "--other\n");
+        BUG_IF_NOT (complete ({"--argb", "--o"}) == "--other\n");
+        BUG_IF_NOT (complete ({"--", "--o"}) == "");
+        // addOption refuses optional arguments of short options, the check must not depend on it
+        obj.options[0].hasOptionalArg = true;
+        BUG_IF_NOT (complete ({"-a", "--o"}) == "--other\n");
+        BUG_IF_NOT (complete ({"-ca", "--o"}) == "--other\n");
+        BUG_IF_NOT (!obj.expectsArgument ("-a") && !obj.expectsArgument ("--arga"));
+        obj.options[0].hasOptionalArg = false;
+
+        std::string script;
+        obj.completionScript (SHELL_BASH, "my-tool", script);
+        BUG_IF_NOT (script.find ("complete -o bashdefault -o default -F _my_tool_complete my-tool\n") != std::string::npos);
+        script.clear ();
+        obj.completionScript (SHELL_ZSH, "my-tool", script);
+        BUG_IF_NOT (script.find ("compdef _my_tool_complete my-tool\n") != std::string::npos);
+        script.clear ();
+        obj.completionScript (SHELL_FISH, "my-tool", script);
+        BUG_IF_NOT (script.find ("complete -c my-tool -s a -l arga -r -d 'it\\'s \\\\ two lines'\n") != std::string::npos);
+        BUG_IF_NOT (script.find ("complete -c my-tool -l argb -d 'optional argument'\n") != std::string::npos);
+        BUG_IF_NOT (script.find ("complete -c my-tool -s c -l other\n") != std::string::npos);
+    }
 }
 #endif
@@ -20,9 +20,61 @@
 #ifndef CMDLINE_HPP_
 #define CMDLINE_HPP_
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
 #include <vector>
 
-typedef enum {ARG_NO, ARG_STRING, ARG_INT}arg_type;
+#include "arena.hpp"
+#include "responsefile.hpp"
+
+// Types of option arguments and what 'arg' of addOption points to. Numbers are checked strictly: the whole
+// argument must be a number of the type and in its range, see cArgConvert.
+typedef enum {
+    ARG_NO,
+    ARG_STRING,     // const char*
+    ARG_INT,        // int; decimal, hex (0x) or octal (0)
+    ARG_INT64,      // int64_t; like ARG_INT
+    ARG_UINT64,     // uint64_t; like ARG_INT, without sign
+    ARG_DOUBLE,     // double; decimal floating point, always with '.' as decimal point
+    ARG_SIZE,       // uint64_t bytes; decimal with optional binary suffix, e.g. 64k, 4G or 4GiB
+    ARG_DURATION,   // int64_t nanoseconds; decimal with units ns, us, ms, s, m, h, d, e.g. 250ms or 1h30m
+    ARG_STRING_LIST,// argList; the arguments of all occurrences
+    ARG_STRING_CSV, // argList; like ARG_STRING_LIST, but each argument is also split at commas
+    ARG_UINT64_LIST,// argNumbers; decimal numbers separated by commas, e.g. 17,42
+    ARG_RANGE_SET   // argNumbers; set of numbers and ranges below cNumberList::RANGE_LIMIT, e.g. 0-63,128-191
+}arg_type;
+
+// one value of a list option; points into argv and is not '\0' terminated
+typedef struct
+{
+    const char* str;
+    size_t      len;
+}argItem;
+
+// values of a list option in the order given; valid until the next parse call
+typedef struct
+{
+    const argItem* items;
+    size_t         count;
+}argList;
+
+// Values of ARG_UINT64_LIST options in the order given. For ARG_RANGE_SET options 'values' is a bitset with 'count'
+// words: n is in the set if bit n % 64 of values[n / 64] is set. Valid until the next parse call.
+typedef struct
+{
+    const uint64_t* values;
+    size_t          count;
+}argNumbers;
+
+// converted argument of a numeric option
+typedef union
+{
+    int64_t  i;     // ARG_INT, ARG_INT64, ARG_DURATION
+    uint64_t u;     // ARG_UINT64, ARG_SIZE
+    double   d;     // ARG_DOUBLE
+}argValue;
 
 typedef struct
 {
@@ -41,12 +93,133 @@ typedef struct
     bool        dontFailIfSet;
 }argument;
 
+// shells cCmdline::completionScript supports
+typedef enum {SHELL_BASH, SHELL_ZSH, SHELL_FISH}shell_type;
+
+typedef enum {CMDLINE_OK, CMDLINE_UNKNOWN_OPTION, CMDLINE_MISSING_ARGUMENT, CMDLINE_MISSING_OPTION,
+    CMDLINE_RESPONSE_FILE, CMDLINE_NO_MEMORY, CMDLINE_INVALID_ARGUMENT, CMDLINE_OUT_OF_RANGE}cmdline_error;
+
+// why a command line was rejected (the first error found)
+typedef struct
+{
+    cmdline_error kind;
+    // index of the offending argument in the (expanded) argv; -1 for missing mandatory options
+    int           argIndex;
+    // index of the option concerned (see cCmdline::indexOf); -1 if unknown
+    int           option;
+    // the offending argument, NULL for missing mandatory options; the invalid value for numeric options
+    const char*   arg;
+}cmdlineError;
+
+// Result of one parse call: how often each option was given, its argument and the permuted command line.
+// Options are identified by their index, i.e. the order of addOption calls (see cCmdline::indexOf).
+class cCmdlineResult
+{
+public:
+    explicit cCmdlineResult (cArena* arena = nullptr);
+
+    int isSet (int option) const
+    {
+        return counts[option];
+    }
+    // last argument given for the option, NULL if none
+    const char* getArg (int option) const
+    {
+        return values[option];
+    }
+    // converted last argument of numeric options, see arg_type
+    int64_t getInt (int option) const
+    {
+        return numbers[option].i;
+    }
+    uint64_t getUnsigned (int option) const
+    {
+        return numbers[option].u;
+    }
+    double getDouble (int option) const
+    {
+        return numbers[option].d;
+    }
+    // values of list options (ARG_STRING_LIST, ARG_STRING_CSV)
+    argList getList (int option) const
+    {
+        return lists[option];
+    }
+    // values of numeric list options (ARG_UINT64_LIST, ARG_RANGE_SET)
+    argNumbers getNumbers (int option) const
+    {
+        return numberLists[option];
+    }
+    // command line with all options in front of the positional arguments, which start at getOptind.
+    // It includes the arguments from response files; they stay valid as long as this object.
+    int getArgc () const
+    {
+        return args.empty () ? 0 : (int)args.size () - 1;
+    }
+    char** getArgv () const
+    {
+        return const_cast<char**>(args.data ());
+    }
+    int getOptind () const
+    {
+        return optind;
+    }
+    // why the last parse call failed; kind is CMDLINE_OK if it succeeded
+    const cmdlineError& getError () const
+    {
+        return error;
+    }
+    // don't print errors to the console, only store them
+    void setQuiet (bool quiet = true)
+    {
+        this->quiet = quiet;
+    }
+
+private:
+    friend class cCmdline;
+
+    std::vector<int, cArenaAllocator<int> > counts;
+    std::vector<char*, cArenaAllocator<char*> > values;
+    std::vector<argValue, cArenaAllocator<argValue> > numbers;
+    // arguments of list options in command line order, then grouped per option into 'items' or 'numberData'
+    typedef struct
+    {
+        int    option;
+        char*  arg;
+        // numbers scanned into 'scratch'
+        size_t first;
+        size_t count;
+    }listArg;
+    std::vector<listArg, cArenaAllocator<listArg> > listArgs;
+    std::vector<argItem, cArenaAllocator<argItem> > items;
+    std::vector<argList, cArenaAllocator<argList> > lists;
+    std::vector<uint64_t, cArenaAllocator<uint64_t> > scratch;
+    std::vector<uint64_t, cArenaAllocator<uint64_t> > numberData;
+    std::vector<argNumbers, cArenaAllocator<argNumbers> > numberLists;
+    // NULL terminated copy of argv
+    std::vector<char*, cArenaAllocator<char*> > args;
+    std::vector<char*, cArenaAllocator<char*> > positionals;
+    std::vector<cResponseFile, cArenaAllocator<cResponseFile> > responseFiles;
+    bool expanded;
+    bool quiet;
+    int optind;
+    cmdlineError error;
+
+    void setError (cmdline_error kind, int argIndex, int option, const char* arg);
+    cmdline_error scanNumbers (int option, char* arg, bool ranges);
+    bool init (size_t options, int argc, char* const argv[], bool expandResponseFiles);
+};
+
 class cCmdline
 {
 public:
     cCmdline (int argc, char* argv[]);
     cCmdline ();
+    // all memory is taken from 'arena', addOption and parse never use the global heap
+    explicit cCmdline (cArena& arena);
     virtual ~cCmdline();
+    cCmdline (const cCmdline&) = delete;
+    cCmdline& operator= (const cCmdline&) = delete;
 
 #ifdef WITH_UNITTESTS
     static void unitTest ();
@@ -55,16 +228,79 @@ public:
     bool addOption (bool optional, char shortname, const char* longname, const char* description, int* isOptionSet,
             const char* argname = nullptr, arg_type type = ARG_NO, void* arg = nullptr, bool hasOptionalArg = false, bool dontFailIfSet = false);
 
+    // avoids reallocations (and wasted arena memory) when adding 'count' options
+    bool reserve (size_t count);
+    // index of an option for cCmdlineResult; -1 if there is no such option
+    int indexOf (char shortname) const;
+    int indexOf (const char* longname) const;
+
+    // parse and store the results in the variables passed to addOption; argv is permuted in place
     bool parse (int* optind = 0);
     bool parse (int argc, char* argv[], int* optind = 0);
+    // Parse without modifying this object or argv. Once all options are added, any number of threads may
+    // call this concurrently, each with its own result object.
+    bool parse (int argc, char* const argv[], cCmdlineResult& result) const;
+    // prints optionsHelp (helpColumns ()) with a single write
     void printOptions ();
+    // Help text of all options for lines of 'width' columns. It is built once per width and kept until options are
+    // added; throws std::bad_alloc.
+    const std::string& optionsHelp (size_t width);
+    // width of help texts: the terminal width, but at most 100 columns
+    static size_t helpColumns ();
+    // column where descriptions start in help texts of 'width' columns
+    static size_t descriptionColumn (size_t width);
+    size_t optionCount () const
+    {
+        return options.size ();
+    }
+    // Completion candidates for the last of 'words', one per line; 'words' are the arguments after the program name
+    // up to the one being completed. Nothing if it is no option, e.g. an option argument. Throws std::bad_alloc.
+    void complete (int count, char* const words[], std::string& out) const;
+    // Script that makes 'shell' complete the options of 'program'. The bash and zsh scripts ask
+    // "program --__complete words...", see cCmdlineApp; the fish script lists the options. Throws std::bad_alloc.
+    void completionScript (shell_type shell, const char* program, std::string& out) const;
+    // true if 'word' is an option whose argument has to be the next word
+    bool expectsArgument (const char* word) const;
+
+    // replace arguments "@file" (up to "--") by the arguments in 'file', see cResponseFile
+    void enableResponseFiles (bool enable = true);
+    // Options end at the first positional argument, it and all following arguments are positional arguments.
+    // By default options and positional arguments may be mixed.
+    void stopAtPositional (bool enable = true);
+    // Command line seen by the last parse call, including the arguments from response files; optind refers to it.
+    // Arguments from response files stay valid until the next parse call.
+    int getArgc () const;
+    char** getArgv () const;
 
 private:
+    friend class cCmdlineBatch;
+
+    // option tables in the format expected by ketopt; built from 'options' on demand
+    struct compiledOptions;
+
+    cCmdline (int argc, char* argv[], cArena* arena);
+
     int argc;
     char** argv;
-    std::vector<argument> options;
+    cArena* arena;
+    std::vector<argument, cArenaAllocator<argument> > options;
+    // maps short option characters (0..255) and synthetic ids of long-only options to their index in 'options'
+    std::vector<int, cArenaAllocator<int> > dispatch;
+    compiledOptions* schema;
+    std::atomic<bool> schemaDirty;
+    mutable std::mutex compileMtx;
+    bool responseFiles;
+    bool inOrder;
+    // result of the last parse (int*) call
+    cCmdlineResult result;
+    // cached optionsHelp and the width it was built for
+    std::string help;
+    size_t helpWidth;
 
-    int findOption (int shortname);
+    bool compile ();
+    bool parseArgs (int argc, char* const argv[], cCmdlineResult& r, bool expandResponseFiles) const;
+    bool checkMandatory (cCmdlineResult& r) const;
+    bool collectLists (cCmdlineResult& r) const;
 };
 
 #endif /* CMDLINE_HPP_ */
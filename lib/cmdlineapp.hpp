@@ -22,13 +22,18 @@
 
 #include "cmdline.hpp"
 #include "console.hpp"
+#include "argsource.hpp"
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <new>
 #include <string>
 #include <vector>
 
-class cCmdlineApp
+class cStreamingCmdlineApp
 {
 public:
-    cCmdlineApp (const char* name, const char* brief, const char* usage, const char* description, const char* version,
+    cStreamingCmdlineApp (const char* name, const char* brief, const char* usage, const char* description, const char* version,
         const char* build = nullptr, const char* buildDetails = nullptr)
     {
             m_name = name;
@@ -42,36 +47,34 @@ public:
             m_helpRequested = 0;
             m_versionRequested = 0;
             m_verbosity = 0;
+            m_argsFrom = nullptr;
+            m_argsNulSeparated = 0;
+            m_helpWidth = 0;
+            m_helpOptions = 0;
 
-            m_cmdline.addOption  (true, 'h', "help", "Display this text", &m_helpRequested, nullptr, ARG_NO, nullptr, false, true);
+            addHelpOption (m_cmdline, &m_helpRequested);
             m_cmdline.addOption  (true, 0, "version", "Show detailed version information", &m_versionRequested, nullptr, ARG_NO, nullptr, false, true);
-            addCmdLineOption (true, 'v', "verbose",
-                "Produce verbose output when parsing and printing. This option can be supplied multiple times (up to 4 times, e.g., -vvvv) for even more debug output."
-                , &m_verbosity);
+            addVerboseOption (m_cmdline, &m_verbosity);
     }
-    virtual ~cCmdlineApp ()
+    virtual ~cStreamingCmdlineApp ()
     {
     }
     int main (int argc, char* argv[])
     {
+        // hidden entries for shell completion, answered before anything else happens
+        if (argc >= 2 && !strcmp (argv[1], "--__complete"))
+            return complete (argc - 2, argv + 2);
+        if (argc == 3 && !strcmp (argv[1], "--__completion-script"))
+            return printCompletionScript (argv[2]);
+
         int index = 0;
         bool parseOk = m_cmdline.parse (argc, argv, &index);
 
-        switch (m_verbosity)
-        {
-        case 1:
-            Console::SetPrintLevel(Console::Verbose);
-            break;
-        case 2:
-            Console::SetPrintLevel(Console::MoreVerbose);
-            break;
-        case 3:
-            Console::SetPrintLevel(Console::MostVerbose);
-            break;
-        case 4:
-            Console::SetPrintLevel(Console::Debug);
-            break;
-        }
+        // the first positional argument selects the subcommand
+        if (parseOk && !m_subcommands.empty () && index < m_cmdline.getArgc () && !m_versionRequested)
+            return runSubcommand (m_cmdline.getArgc () - index, m_cmdline.getArgv () + index);
+
+        setPrintLevel ();
 
         if (m_helpRequested)
         {
@@ -89,28 +92,139 @@ public:
             Console::PrintError ("try %s -h\n", argv[0]);
             return -1;
         }
+        if (!m_subcommands.empty ())
+        {
+            Console::PrintError ("Command missing, try %s -h\n", argv[0]);
+            return -1;
+        }
 
-        std::vector <std::string> args;
-
-        for (int n = index; n < argc; n++)
+        // positional arguments from argv (with expanded response files) and from --args-from
+        cArgSource args (m_cmdline.getArgc () - index, m_cmdline.getArgv () + index);
+        if (m_argsFrom && !args.open (m_argsFrom, m_argsNulSeparated != 0))
         {
-            args.emplace_back(argv[n]);
+            Console::PrintError ("Cannot read arguments from `%s'.\n", m_argsFrom);
+            return -1;
         }
 
-        return this->execute (args);
+        return this->executeStream (args);
     }
 
 protected:
-    virtual int execute (const std::vector<std::string>& args) = 0;
+    // gets the positional arguments one by one, so they don't have to be held in memory at once (see enableArgsFrom)
+    virtual int executeStream (cArgSource& source) = 0;
+    // the whole help text with a single write; it is built once per width and kept until options or subcommands are
+    // added
     void printUsage ()
     {
-        Console::Print ("%s %s - %s\n\nUsage: ", m_name, m_version, m_brief);
-        Console::PrintWrapedText (m_usage, 100, 0, 7);
-        Console::Print ("\n");
-        m_cmdline.printOptions ();
-        Console::Print ("\n");
-        Console::PrintWrapedText (m_description, 100);
-        Console::Print ("\n");
+        size_t width = cCmdline::helpColumns ();
+        try
+        {
+            if (m_help.empty () || width != m_helpWidth || m_cmdline.optionCount () != m_helpOptions)
+            {
+                m_help.clear ();
+                m_help.append (m_name).append (" ").append (m_version).append (" - ").append (m_brief);
+                m_help.append ("\n\nUsage: ");
+                Console::WrapText (m_help, m_usage, width, 0, 7);
+                m_help.append ("\n").append (m_cmdline.optionsHelp (width)).append ("\n");
+                if (!m_subcommands.empty ())
+                {
+                    size_t column = cCmdline::descriptionColumn (width);
+                    m_help.append ("Commands:\n");
+                    for (const subcommand& command : m_subcommands)
+                    {
+                        m_help.append (" ").append (command.name).append ("\n");
+                        Console::WrapText (m_help, command.brief, width, column, column);
+                    }
+                    m_help.append ("\n");
+                }
+                Console::WrapText (m_help, m_description, width);
+                m_help.append ("\n");
+                m_helpWidth = width;
+                m_helpOptions = m_cmdline.optionCount ();
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            m_help.clear ();
+            Console::PrintError ("Not enough memory\n");
+            return;
+        }
+        Console::Write (Console::Normal, m_help.data (), m_help.size ());
+    }
+    // completion candidates for the shell scripts, see cCmdline::complete
+    int complete (int count, char* words[])
+    {
+        std::string out;
+        try
+        {
+            // global options up to the subcommand
+            int n = 0;
+            while (!m_subcommands.empty () && n < count - 1 && words[n][0] == '-' && words[n][1])
+                n += m_cmdline.expectsArgument (words[n]) ? 2 : 1;
+
+            if (m_subcommands.empty () || n >= count || words[n][0] == '-')
+            {
+                m_cmdline.complete (count, words, out);
+            }
+            else if (n == count - 1)
+            {
+                size_t len = strlen (words[n]);
+                for (const subcommand& command : m_subcommands)
+                {
+                    if (!strncmp (command.name, words[n], len))
+                        out.append (command.name).append ("\n");
+                }
+            }
+            else if (const subcommand* command = findSubcommand (words[n]))
+            {
+                int help, verbosity;
+                cCmdline cmdline;
+                addHelpOption (cmdline, &help);
+                addVerboseOption (cmdline, &verbosity);
+                command->options (cmdline);
+                cmdline.complete (count - n - 1, words + n + 1, out);
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            return -1;
+        }
+        return fwrite (out.data (), 1, out.size (), stdout) == out.size () ? 0 : -1;
+    }
+    // "program --__completion-script bash|zsh|fish" prints the completion script for the shell
+    int printCompletionScript (const char* shell)
+    {
+        const char* shells[] = {"bash", "zsh", "fish"};
+        const shell_type types[] = {SHELL_BASH, SHELL_ZSH, SHELL_FISH};
+        for (unsigned n = 0; n < sizeof (shells) / sizeof (shells[0]); n++)
+        {
+            if (strcmp (shell, shells[n]))
+                continue;
+            std::string out;
+            try
+            {
+                // the options of subcommands are only known to --__complete
+                if (types[n] == SHELL_FISH && !m_subcommands.empty ())
+                {
+                    out.append ("# fish completion for ").append (m_name).append (", save it as ~/.config/fish/completions/")
+                       .append (m_name).append (".fish\n");
+                    out.append ("complete -c ").append (m_name).append (" -a '(").append (m_name)
+                       .append (" --__complete (commandline -opc)[2..-1] (commandline -ct))'\n");
+                }
+                else
+                {
+                    m_cmdline.completionScript (types[n], m_name, out);
+                }
+            }
+            catch (const std::bad_alloc&)
+            {
+                Console::PrintError ("Not enough memory\n");
+                return -1;
+            }
+            return fwrite (out.data (), 1, out.size (), stdout) == out.size () ? 0 : -1;
+        }
+        Console::PrintError ("Unknown shell `%s', supported are bash, zsh and fish.\n", shell);
+        return -1;
     }
     void printVersion ()
     {
@@ -146,13 +260,162 @@ protected:
     {
         return m_cmdline.addOption (optional, 0, longname, description, optSet, argname, ARG_STRING, (void*)arg, true);
     }
+    // arguments "@file" are replaced by the content of 'file'
+    void enableResponseFiles ()
+    {
+        m_cmdline.enableResponseFiles ();
+    }
+    // adds the options --args-from and -0 to read further positional arguments from a file or stdin
+    void enableArgsFrom ()
+    {
+        m_cmdline.addOption (true, 0, "args-from", "Read further arguments from FILE (- is stdin), one per line.",
+            nullptr, "FILE", ARG_STRING, (void*)&m_argsFrom);
+        m_cmdline.addOption (true, '0', "null", "Arguments read with --args-from are separated by a null character, not by newlines.",
+            &m_argsNulSeparated);
+    }
     // adds boolean (optional) option without argument
     bool addCmdLineOption (bool optional, char shortname, const char* longname, const char* description, int* optSet)
     {
         return m_cmdline.addOption (optional, shortname, longname, description, optSet);
     }
 
+    // Subcommands: "program [global options] NAME [options of NAME] arguments". Only the options of the selected
+    // subcommand are added, by 'options' to a cCmdline of its own. 'execute' gets the positional arguments after them
+    // and replaces executeStream. -h and -v may be given before and after NAME.
+    typedef std::function<void (cCmdline& cmdline)> subcommandOptions;
+    typedef std::function<int (cArgSource& args)> subcommandExecute;
+    bool addSubcommand (const char* name, const char* brief, const char* usage, subcommandOptions options,
+            subcommandExecute execute)
+    {
+        try
+        {
+            m_subcommands.push_back (subcommand {name, brief, usage, std::move (options), std::move (execute)});
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+        m_cmdline.stopAtPositional ();
+        m_help.clear ();
+        return true;
+    }
+
 private:
+    struct subcommand
+    {
+        const char*       name;
+        const char*       brief;
+        const char*       usage;
+        subcommandOptions options;
+        subcommandExecute execute;
+    };
+
+    static void addHelpOption (cCmdline& cmdline, int* helpRequested)
+    {
+        cmdline.addOption (true, 'h', "help", "Display this text", helpRequested, nullptr, ARG_NO, nullptr, false, true);
+    }
+    static void addVerboseOption (cCmdline& cmdline, int* verbosity)
+    {
+        cmdline.addOption (true, 'v', "verbose",
+            "Produce verbose output when parsing and printing. This option can be supplied multiple times (up to 4 times, e.g., -vvvv) for even more debug output."
+            , verbosity);
+    }
+    void setPrintLevel ()
+    {
+        switch (m_verbosity)
+        {
+        case 1:
+            Console::SetPrintLevel(Console::Verbose);
+            break;
+        case 2:
+            Console::SetPrintLevel(Console::MoreVerbose);
+            break;
+        case 3:
+            Console::SetPrintLevel(Console::MostVerbose);
+            break;
+        case 4:
+            Console::SetPrintLevel(Console::Debug);
+            break;
+        }
+    }
+    const subcommand* findSubcommand (const char* name) const
+    {
+        for (const subcommand& command : m_subcommands)
+        {
+            if (!strcmp (command.name, name))
+                return &command;
+        }
+        return nullptr;
+    }
+    // 'argv[0]' is the name of the subcommand
+    int runSubcommand (int argc, char* argv[])
+    {
+        const subcommand* command = findSubcommand (argv[0]);
+        if (!command)
+        {
+            setPrintLevel ();
+            if (m_helpRequested)
+            {
+                printUsage ();
+                return 0;
+            }
+            Console::PrintError ("Unknown command `%s', try %s -h\n", argv[0], m_name);
+            return -1;
+        }
+
+        // -h and -v count like before the subcommand
+        int help = 0;
+        int verbosity = 0;
+        cCmdline cmdline;
+        addHelpOption (cmdline, &help);
+        addVerboseOption (cmdline, &verbosity);
+        command->options (cmdline);
+
+        int index = 0;
+        bool parseOk = cmdline.parse (argc, argv, &index);
+        m_helpRequested += help;
+        m_verbosity += verbosity;
+        setPrintLevel ();
+
+        if (m_helpRequested)
+        {
+            printUsage (*command, cmdline);
+            return 0;
+        }
+        if (!parseOk)
+        {
+            Console::PrintError ("try %s %s -h\n", m_name, command->name);
+            return -1;
+        }
+
+        cArgSource args (cmdline.getArgc () - index, cmdline.getArgv () + index);
+        if (m_argsFrom && !args.open (m_argsFrom, m_argsNulSeparated != 0))
+        {
+            Console::PrintError ("Cannot read arguments from `%s'.\n", m_argsFrom);
+            return -1;
+        }
+        return command->execute (args);
+    }
+    // help of a subcommand, built on demand like its options
+    void printUsage (const subcommand& command, cCmdline& cmdline)
+    {
+        size_t width = cCmdline::helpColumns ();
+        std::string help;
+        try
+        {
+            help.append (m_name).append (" ").append (command.name).append (" - ").append (command.brief);
+            help.append ("\n\nUsage: ");
+            Console::WrapText (help, command.usage, width, 0, 7);
+            help.append ("\n").append (cmdline.optionsHelp (width));
+        }
+        catch (const std::bad_alloc&)
+        {
+            Console::PrintError ("Not enough memory\n");
+            return;
+        }
+        Console::Write (Console::Normal, help.data (), help.size ());
+    }
+
     const char* m_name;
     const char* m_brief;
     const char* m_usage;
@@ -163,7 +426,44 @@ private:
     int m_helpRequested;
     int m_versionRequested;
     int m_verbosity;
+    const char* m_argsFrom;
+    int m_argsNulSeparated;
+    // cached printUsage text, the width and the number of options it was built for
+    std::string m_help;
+    size_t m_helpWidth;
+    size_t m_helpOptions;
+    std::vector<subcommand> m_subcommands;
     cCmdline m_cmdline;
 };
 
+// applications that get all positional arguments at once
+class cCmdlineApp : public cStreamingCmdlineApp
+{
+public:
+    using cStreamingCmdlineApp::cStreamingCmdlineApp;
+
+protected:
+    virtual int execute (const std::vector<std::string>& args) = 0;
+
+private:
+    int executeStream (cArgSource& source) override final
+    {
+        std::vector <std::string> args;
+        const char* arg;
+        size_t len;
+
+        while ((arg = source.next (&len)) != NULL)
+        {
+            args.emplace_back(arg, len);
+        }
+        if (source.error ())
+        {
+            Console::PrintError ("Reading arguments failed.\n");
+            return -1;
+        }
+
+        return this->execute (args);
+    }
+};
+
 #endif /* CMDLINE_HPP_ */
@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <thread>
+#ifdef WITH_UNITTESTS
+#include <string>
+#endif
+
+#include "cmdlinebatch.hpp"
+#include "bug.hpp"
+#include "console.hpp"
+
+
+// part of the text validated by one thread; all but the last one end behind a '\n'
+struct cCmdlineBatch::chunk
+{
+    char*  begin;
+    char*  end;
+    size_t lines;
+    size_t commands;
+    bool   ok;
+    std::vector<failure> failures;
+};
+
+// chunks are only worth a thread if they have at least this size
+static const size_t MIN_CHUNK = 64 * 1024;
+
+
+cCmdlineBatch::cCmdlineBatch (const cCmdline& cmdline)
+: cmdline (cmdline)
+{
+    commands = 0;
+}
+
+bool cCmdlineBatch::validateFile (const char* path, unsigned threads)
+{
+    if (!file.open (path))
+    {
+        commands = 0;
+        failures.clear ();
+        return false;
+    }
+    return validate (file.begin (), (size_t)(file.end () - file.begin ()), threads);
+}
+
+bool cCmdlineBatch::validate (char* text, size_t len, unsigned threads)
+{
+    commands = 0;
+    failures.clear ();
+
+    if (!threads)
+        threads = std::thread::hardware_concurrency ();
+    if (!threads)
+        threads = 1;
+    if (threads > len / MIN_CHUNK + 1)
+        threads = (unsigned)(len / MIN_CHUNK + 1);
+
+    std::vector<chunk> chunks;
+    std::vector<std::thread> workers;
+    bool ok = true;
+    try
+    {
+        chunks.resize (threads);
+        char* pos = text;
+        char* end = text + len;
+        for (unsigned n = 0; n < threads; n++)
+        {
+            char* chunkEnd = n + 1 < threads ? text + len / threads * (n + 1) : end;
+            if (chunkEnd < pos)
+                chunkEnd = pos;
+            char* eol = chunkEnd < end ? (char*)memchr (chunkEnd, '\n', (size_t)(end - chunkEnd)) : NULL;
+            chunkEnd = eol ? eol + 1 : end;
+
+            chunks[n].begin    = pos;
+            chunks[n].end      = chunkEnd;
+            chunks[n].lines    = 0;
+            chunks[n].commands = 0;
+            chunks[n].ok       = true;
+            pos = chunkEnd;
+        }
+
+        // the first chunk is validated by the calling thread
+        workers.reserve (threads - 1);
+        for (unsigned n = 1; n < threads; n++)
+        {
+            try
+            {
+                workers.emplace_back (validateChunk, std::cref (cmdline), std::ref (chunks[n]));
+            }
+            catch (const std::system_error&)
+            {
+                // no more threads, the remaining chunks are validated below
+                break;
+            }
+        }
+        validateChunk (cmdline, chunks[0]);
+        for (size_t n = workers.size () + 1; n < chunks.size (); n++)
+            validateChunk (cmdline, chunks[n]);
+    }
+    catch (const std::bad_alloc&)
+    {
+        ok = false;
+    }
+    for (auto& worker : workers)
+        worker.join ();
+
+    size_t lines = 0;
+    for (size_t n = 0; ok && n < chunks.size (); n++)
+    {
+        ok = chunks[n].ok;
+        try
+        {
+            for (failure f : chunks[n].failures)
+            {
+                f.line += lines;
+                failures.push_back (f);
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            ok = false;
+        }
+        lines    += chunks[n].lines;
+        commands += chunks[n].commands;
+    }
+    if (!ok)
+    {
+        Console::PrintError ("Not enough memory\n");
+        commands = 0;
+        failures.clear ();
+    }
+    return ok;
+}
+
+void cCmdlineBatch::validateChunk (const cCmdline& cmdline, chunk& c)
+{
+    try
+    {
+        cCmdlineResult r;
+        r.setQuiet ();
+        std::vector<char*> argv;
+
+        char* pos = c.begin;
+        while (pos < c.end)
+        {
+            char* eol = (char*)memchr (pos, '\n', (size_t)(c.end - pos));
+            if (!eol)
+                eol = c.end;
+            c.lines++;
+
+            // nextArg terminates the last argument at 'eol' at the latest, i.e. it never writes into the next line
+            argv.clear ();
+            char* arg;
+            while ((arg = cResponseFile::nextArg (pos, eol)) != NULL)
+                argv.push_back (arg);
+            pos = eol + 1;
+            if (argv.empty ())
+                continue;
+
+            c.commands++;
+            argv.push_back (NULL);
+            if (!cmdline.parseArgs ((int)argv.size () - 1, argv.data (), r, false))
+            {
+                failure f;
+                f.line  = c.lines;
+                f.error = r.getError ();
+                c.failures.push_back (f);
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        c.ok = false;
+    }
+}
+
+
+#ifdef WITH_UNITTESTS
+void cCmdlineBatch::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+    cCmdline cmdline;
+    BUG_IF_NOT (cmdline.addOption (false, 'a', "arga", "mandatory option with args", nullptr, "ARG", ARG_STRING, nullptr));
+    BUG_IF_NOT (cmdline.addOption (true, 'b', "argb", "optional option with args", nullptr, "ARG", ARG_INT, nullptr));
+    BUG_IF_NOT (cmdline.addOption (true, 'v', "verbose", "optional option without args", nullptr));
+    BUG_IF_NOT (cmdline.addOption (true, 'h', "help", "help", nullptr, nullptr, ARG_NO, nullptr, false, true));
+
+    {
+        char text[] =
+            "prog -a x pos1 pos2\n"
+            "\n"
+            "prog --arga='with space' -vv\n"
+            "prog -x -a x\n"
+            "   \t  \r\n"
+            "prog pos -b\n"
+            "prog -v\n"
+            "prog --help\n"
+            "prog -a x @file --argb=3 \"--unknown\"\n"
+            "prog --arg=x\n"
+            "prog -a x -- --unknown";
+
+        cCmdlineBatch batch (cmdline);
+        BUG_IF_NOT (batch.validate (text, sizeof (text) - 1, 1));
+        BUG_IF_NOT (batch.getCommands () == 9);
+        const std::vector<failure>& f = batch.getFailures ();
+        BUG_IF_NOT (f.size () == 5);
+        BUG_IF_NOT (f[0].line == 4 && f[0].error.kind == CMDLINE_UNKNOWN_OPTION && f[0].error.argIndex == 1);
+        BUG_IF_NOT (f[0].error.option == -1 && !strcmp (f[0].error.arg, "-x"));
+        BUG_IF_NOT (f[1].line == 6 && f[1].error.kind == CMDLINE_MISSING_ARGUMENT && f[1].error.argIndex == 2);
+        BUG_IF_NOT (f[1].error.option == 1 && !strcmp (f[1].error.arg, "-b"));
+        BUG_IF_NOT (f[2].line == 7 && f[2].error.kind == CMDLINE_MISSING_OPTION && f[2].error.argIndex == -1);
+        BUG_IF_NOT (f[2].error.option == 0 && !f[2].error.arg);
+        BUG_IF_NOT (f[3].line == 9 && f[3].error.kind == CMDLINE_UNKNOWN_OPTION && f[3].error.argIndex == 5);
+        BUG_IF_NOT (!strcmp (f[3].error.arg, "--unknown"));
+        // ambiguous abbreviation
+        BUG_IF_NOT (f[4].line == 10 && f[4].error.kind == CMDLINE_UNKNOWN_OPTION && f[4].error.argIndex == 1);
+    }
+    {
+        // several threads must give the same result as one
+        std::string text;
+        for (int n = 0; n < 100000; n++)
+        {
+            if (n % 7 == 0)
+                text += "prog -b 1 pos\n";
+            else if (n % 11 == 0)
+                text += "prog --unknown -a 1\n";
+            else if (n % 13 == 0)
+                text += "\n";
+            else
+                text += "prog -a " + std::to_string (n) + " --argb=" + std::to_string (n) + " -v pos\n";
+        }
+        std::string copy = text;
+
+        cCmdlineBatch single (cmdline);
+        cCmdlineBatch multi (cmdline);
+        BUG_IF_NOT (single.validate (&text[0], text.size (), 1));
+        BUG_IF_NOT (multi.validate (&copy[0], copy.size (), 8));
+        BUG_IF_NOT (single.getCommands () == multi.getCommands ());
+        BUG_IF_NOT (single.getFailures ().size () == multi.getFailures ().size ());
+        size_t expected = 0;
+        for (int n = 0; n < 100000; n++)
+            expected += n % 7 == 0 || n % 11 == 0;
+        BUG_IF_NOT (single.getFailures ().size () == expected);
+        for (size_t n = 0; n < single.getFailures ().size (); n++)
+        {
+            const failure& s = single.getFailures ()[n];
+            const failure& m = multi.getFailures ()[n];
+            BUG_IF_NOT (s.line == m.line && s.error.kind == m.error.kind && s.error.argIndex == m.error.argIndex);
+            BUG_IF_NOT (s.error.option == m.error.option);
+            BUG_IF_NOT ((s.line - 1) % 7 == 0 || (s.line - 1) % 11 == 0);
+        }
+    }
+    {
+        cCmdlineBatch batch (cmdline);
+        char text[] = "";
+        BUG_IF_NOT (batch.validate (text, 0));
+        BUG_IF_NOT (batch.getCommands () == 0 && batch.getFailures ().empty ());
+        BUG_IF_NOT (!batch.validateFile ("/nonexistent/file"));
+    }
+}
+#endif
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CMDLINEBATCH_HPP_
+#define CMDLINEBATCH_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "cmdline.hpp"
+#include "responsefile.hpp"
+
+// Validates many command lines against the options of one cCmdline, e.g. stored job command lines before they are
+// dispatched. Every line is one command line including the program name. It is split like a response file (see
+// cResponseFile), but "@file" arguments are not expanded. Nothing is printed, rejected lines are reported as
+// failure records. The lines are split in place and validated in parallel.
+class cCmdlineBatch
+{
+public:
+    typedef struct
+    {
+        // 1-based line number
+        size_t       line;
+        // error.arg points into the validated text
+        cmdlineError error;
+    }failure;
+
+    explicit cCmdlineBatch (const cCmdline& cmdline);
+    cCmdlineBatch (const cCmdlineBatch&) = delete;
+    cCmdlineBatch& operator= (const cCmdlineBatch&) = delete;
+
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    // Validate all lines of a file or of 'len' bytes of 'text', which is modified (text[len] must be writable).
+    // 'threads' == 0 uses all cores. Returns false if the file can't be read or memory is exhausted.
+    bool validateFile (const char* path, unsigned threads = 0);
+    bool validate (char* text, size_t len, unsigned threads = 0);
+
+    // number of command lines (non-empty lines) of the last validate call
+    size_t getCommands () const
+    {
+        return commands;
+    }
+    // rejected lines in ascending order
+    const std::vector<failure>& getFailures () const
+    {
+        return failures;
+    }
+
+private:
+    struct chunk;
+
+    const cCmdline& cmdline;
+    cResponseFile file;
+    size_t commands;
+    std::vector<failure> failures;
+
+    static void validateChunk (const cCmdline& cmdline, chunk& c);
+};
+
+#endif /* CMDLINEBATCH_HPP_ */
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CMDLINEPARSER_HPP_
+#define CMDLINEPARSER_HPP_
+
+// internal header, shared by cCmdline and cStaticCmdline
+
+#include <cstddef>
+#include <vector>
+
+#include "ketopt.h"
+#include "bug.hpp"
+#include "cmdline.hpp"
+#include "console.hpp"
+
+
+// long-only options get synthetic ids NO_SHORTNAME + index
+const int NO_SHORTNAME = 0x100;
+
+
+// slot of a short option character or synthetic long-only id in the dispatch table
+inline unsigned dispatchSlot (int shortname)
+{
+    return shortname < NO_SHORTNAME ? (unsigned char)shortname : (unsigned)shortname;
+}
+
+// option tables in the format expected by ketopt
+struct cmdlineTables
+{
+    const char*         shortopts;
+    const ko_longopt_t* longopts;
+    ko_lookup_t         lookup;
+    const void*         lookupCtx;
+    // maps dispatchSlot() of ketopt's return value to the index of the option
+    const int*          dispatch;
+    size_t              dispatchSize;
+    // parsing stops at the first non-option argument instead of permuting
+    bool                inOrder;
+};
+
+
+// index of the option for ketopt's return value or -1
+inline int dispatchOption (const cmdlineTables& tables, int opt)
+{
+    unsigned slot = dispatchSlot (opt);
+    return slot < tables.dispatchSize ? tables.dispatch[slot] : -1;
+}
+
+
+// Parses all options in argv and calls onOption (index, arg) for each of them. 'arg' is NULL for options without
+// argument. onOption returns CMDLINE_OK or the error of the argument (e.g. CMDLINE_INVALID_ARGUMENT). Afterwards
+// argv is permuted so that all options precede the non-option arguments (see below) and 'optind' is the index of
+// the first non-option argument.
+// 'positionals' is scratch space for char* with clear, push_back, size and operator[], e.g. a vector. Nothing is
+// allocated if it holds argc pointers without growing.
+// Nothing is printed, parsing stops at the first error which is stored in 'error'.
+template <typename V, typename F>
+bool cmdlineParse (const cmdlineTables& tables, int argc, char* argv[], V& positionals, int& optind, F onOption,
+        cmdlineError& error)
+{
+    ketopt_t opt = KETOPT_INIT;
+    bool ret = true;
+
+    error.kind     = CMDLINE_OK;
+    error.argIndex = -1;
+    error.option   = -1;
+    error.arg      = NULL;
+
+    // Options are moved to the front of argv and non-option arguments to its end, both in their original order.
+    // ketopt itself would shift all preceding non-option arguments for every option (quadratic), so it doesn't
+    // permute. We collect the non-option arguments and compact the options in a single pass instead.
+    positionals.clear ();
+    int done = opt.i;  // argv[1..done) are either moved to argv[1..nextOpt) or collected in 'positionals'
+    int nextOpt = opt.i;
+    while (ret)
+    {
+        int token = opt.i;
+        int result = ketopt (&opt, argc, argv, 0, tables.shortopts, tables.longopts, tables.lookup, tables.lookupCtx);
+
+        if (result == '?' || result == ':')
+        {
+            // argv[token..argc) is still in its original order
+            error.kind     = result == '?' ? CMDLINE_UNKNOWN_OPTION : CMDLINE_MISSING_ARGUMENT;
+            error.argIndex = token;
+            error.option   = result == '?' ? -1 : dispatchOption (tables, opt.opt);
+            error.arg      = argv[token];
+            ret = false;
+        }
+        else if (result >= 0)
+        {
+            int option = dispatchOption (tables, opt.opt);
+            if (option >= 0)
+            {
+                cmdline_error e = onOption (option, opt.arg);
+                if (e != CMDLINE_OK)
+                {
+                    error.kind     = e;
+                    error.argIndex = token;
+                    error.option   = option;
+                    error.arg      = opt.arg;
+                    ret = false;
+                }
+            }
+            else
+            {
+                BUG ("getopt returned unexpected value");
+            }
+        }
+
+        // option tokens (incl. their arguments) that are completely parsed; 'opt.i' doesn't advance within "-abc"
+        for (; done < opt.i; done++)
+            argv[nextOpt++] = argv[done];
+
+        if (result == -1)
+        {
+            if (opt.i >= argc)
+                break;
+            if (token < opt.i)
+            {
+                // "--" terminates option parsing, it stays in front of all non-option arguments
+                for (; done < argc; done++)
+                    positionals.push_back (argv[done]);
+                break;
+            }
+            if (tables.inOrder)
+            {
+                // the rest of argv stays as it is, 'done' == opt.i
+                for (; done < argc; done++)
+                    positionals.push_back (argv[done]);
+                break;
+            }
+            positionals.push_back (argv[opt.i]);
+            done = ++opt.i;
+        }
+    }
+    // there are exactly as many free slots as collected arguments; anything behind 'done' was not parsed (error)
+    for (size_t n = 0; n < positionals.size (); n++)
+        argv[nextOpt + n] = positionals[n];
+    optind = nextOpt;
+
+    return ret;
+}
+
+// prints an error found by cmdlineParse; 'shortname' and 'longname' are those of error.option
+inline void printParseError (const cmdlineError& error, int shortname, const char* longname)
+{
+    char name[3] = {'-', shortname < NO_SHORTNAME ? (char)shortname : '\0', '\0'};
+
+    if (error.kind == CMDLINE_UNKNOWN_OPTION)
+        Console::PrintError ("Unknown option `%s'.\n", error.arg);
+    else if (error.kind == CMDLINE_MISSING_ARGUMENT)
+        Console::PrintError ("Option %s requires an argument.\n", error.arg);
+    else if (error.kind == CMDLINE_INVALID_ARGUMENT)
+        Console::PrintError ("Invalid argument `%s' for option %s%s.\n", error.arg, longname ? "--" : name, longname ? longname : "");
+    else if (error.kind == CMDLINE_OUT_OF_RANGE)
+        Console::PrintError ("Argument `%s' for option %s%s is out of range.\n", error.arg, longname ? "--" : name, longname ? longname : "");
+}
+
+#endif /* CMDLINEPARSER_HPP_ */
@@ -0,0 +1,391 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CMDLINESCHEMA_HPP_
+#define CMDLINESCHEMA_HPP_
+
+#if __cplusplus < 201703L
+#error "cmdlineschema.hpp requires C++17, configure with -DWITH_CXX17=ON"
+#endif
+
+#include <array>
+#include <cstring>
+#include <iterator>
+
+#include "argconvert.hpp"
+#include "cmdline.hpp"
+#include "cmdlineparser.hpp"
+
+
+// Declaration of one option of a cStaticCmdline. The members have the same meaning as the parameters of
+// cCmdline::addOption.
+struct optionSpec
+{
+    bool        optional;
+    char        shortname;
+    const char* longname;
+    const char* description;
+    const char* argname        = nullptr;
+    arg_type    type           = ARG_NO;
+    bool        hasOptionalArg = false;
+    bool        dontFailIfSet  = false;
+};
+
+
+namespace cmdlineSchema
+{
+    constexpr bool equal (const char* a, const char* b)
+    {
+        for (; *a && *a == *b; a++, b++)
+        {
+        }
+        return *a == *b;
+    }
+
+    // same order as strcmp/strncmp
+    constexpr bool less (const char* a, const char* b)
+    {
+        for (; *a && *a == *b; a++, b++)
+        {
+        }
+        return (unsigned char)*a < (unsigned char)*b;
+    }
+
+    constexpr size_t length (const char* s)
+    {
+        size_t len = 0;
+        while (s[len])
+            len++;
+        return len;
+    }
+
+    template <size_t N>
+    constexpr bool namesPresent (const optionSpec (&specs)[N])
+    {
+        for (size_t n = 0; n < N; n++)
+            if (!specs[n].shortname && !specs[n].longname)
+                return false;
+        return true;
+    }
+
+    template <size_t N>
+    constexpr bool longnamesValid (const optionSpec (&specs)[N])
+    {
+        for (size_t n = 0; n < N; n++)
+            if (specs[n].longname && length (specs[n].longname) <= 1)
+                return false;
+        return true;
+    }
+
+    template <size_t N>
+    constexpr bool optionalArgsValid (const optionSpec (&specs)[N])
+    {
+        for (size_t n = 0; n < N; n++)
+            if (specs[n].hasOptionalArg && specs[n].shortname)
+                return false;
+        return true;
+    }
+
+    template <size_t N>
+    constexpr bool noLists (const optionSpec (&specs)[N])
+    {
+        for (size_t n = 0; n < N; n++)
+            if (specs[n].type == ARG_STRING_LIST || specs[n].type == ARG_STRING_CSV ||
+                specs[n].type == ARG_UINT64_LIST || specs[n].type == ARG_RANGE_SET)
+                return false;
+        return true;
+    }
+
+    template <size_t N>
+    constexpr bool shortnamesUnique (const optionSpec (&specs)[N])
+    {
+        for (size_t n = 0; n < N; n++)
+            for (size_t k = n + 1; k < N; k++)
+                if (specs[n].shortname && specs[n].shortname == specs[k].shortname)
+                    return false;
+        return true;
+    }
+
+    template <size_t N>
+    constexpr bool longnamesUnique (const optionSpec (&specs)[N])
+    {
+        for (size_t n = 0; n < N; n++)
+            for (size_t k = n + 1; k < N; k++)
+                if (specs[n].longname && specs[k].longname && equal (specs[n].longname, specs[k].longname))
+                    return false;
+        return true;
+    }
+
+    template <size_t N>
+    constexpr size_t countLongnames (const optionSpec (&specs)[N])
+    {
+        size_t count = 0;
+        for (size_t n = 0; n < N; n++)
+            if (specs[n].longname)
+                count++;
+        return count;
+    }
+
+    // synthetic id of long-only options, the same as cCmdline uses
+    constexpr int optionId (const optionSpec& spec, size_t index)
+    {
+        return spec.shortname ? spec.shortname : NO_SHORTNAME + (int)index;
+    }
+}
+
+
+// Option schema that is completely built at compile time: the ketopt tables, a sorted long option index and the
+// dispatch table are constexpr, so there is no registration at runtime and nothing is allocated at startup.
+// Parsing doesn't allocate either; it fails if there are more than MaxArgs arguments.
+// Usage:
+//     static constexpr optionSpec specs[] = {{false, 'a', "arga", "mandatory option with args", "ARG", ARG_STRING}, ...};
+//     cStaticCmdline<specs>::result result;
+//     cStaticCmdline<specs>::parse (argc, argv, result);
+//     if (result.isSet[cStaticCmdline<specs>::indexOf ('a')]) ...
+template <const auto& Specs, size_t MaxArgs = 256>
+class cStaticCmdline
+{
+public:
+    static constexpr size_t size = std::size (Specs);
+
+    static_assert (size > 0, "schema without options");
+    static_assert (cmdlineSchema::namesPresent (Specs), "either shortname or longname must be != null");
+    static_assert (cmdlineSchema::longnamesValid (Specs), "long option names need at least two characters");
+    static_assert (cmdlineSchema::optionalArgsValid (Specs), "optional arguments are only possible with long options");
+    static_assert (cmdlineSchema::noLists (Specs), "list options are only supported by cCmdline");
+    static_assert (cmdlineSchema::shortnamesUnique (Specs), "duplicate short option");
+    static_assert (cmdlineSchema::longnamesUnique (Specs), "duplicate long option");
+
+    // the non-option arguments collected by cmdlineParse
+    class argBuffer
+    {
+    public:
+        void clear ()
+        {
+            count = 0;
+        }
+        void push_back (char* arg)
+        {
+            BUG_ON (count >= MaxArgs);
+            args[count++] = arg;
+        }
+        size_t size () const
+        {
+            return count;
+        }
+        char* operator[] (size_t n) const
+        {
+            return args[n];
+        }
+
+    private:
+        std::array<char*, MaxArgs> args;
+        size_t count = 0;
+    };
+
+    // result of one parse call, indexed like Specs
+    struct result
+    {
+        std::array<int, size>         isSet;
+        std::array<const char*, size> strArg;
+        std::array<int, size>         intArg;
+        // converted arguments of numeric options, see arg_type
+        std::array<argValue, size>    value;
+        // scratch space for the parser
+        argBuffer                     positionals;
+    };
+
+    // index of an option in Specs, usable in constant expressions
+    static constexpr size_t indexOf (char shortname)
+    {
+        for (size_t n = 0; n < size; n++)
+            if (Specs[n].shortname == shortname)
+                return n;
+        return size;
+    }
+    static constexpr size_t indexOf (const char* longname)
+    {
+        for (size_t n = 0; n < size; n++)
+            if (Specs[n].longname && cmdlineSchema::equal (Specs[n].longname, longname))
+                return n;
+        return size;
+    }
+
+    static bool parse (int argc, char* argv[], result& r, int* optind = nullptr)
+    {
+        r.isSet.fill (0);
+        r.strArg.fill (nullptr);
+        r.intArg.fill (0);
+        r.value.fill (argValue ());
+        if (argc > 0 && (size_t)argc - 1 > MaxArgs)
+        {
+            Console::PrintError ("Too many arguments, at most %u are possible.\n", (unsigned)MaxArgs);
+            if (optind)
+                *optind = 1;
+            return false;
+        }
+
+        cmdlineTables tables;
+        tables.shortopts    = shortopts.data ();
+        tables.longopts     = longopts.data ();
+        tables.lookup       = lookupLongOption;
+        tables.lookupCtx    = nullptr;
+        tables.dispatch     = dispatch.data ();
+        tables.dispatchSize = dispatch.size ();
+        tables.inOrder      = false;
+
+        int index;
+        cmdlineError error;
+        bool ret = cmdlineParse (tables, argc, argv, r.positionals, index, [&r](int option, char* arg)
+        {
+            const optionSpec& o = Specs[option];
+            r.isSet[option]++;
+            if (o.argname && arg)
+            {
+                r.strArg[option] = arg;
+                cmdline_error e = cArgConvert::convert (o.type, arg, r.value[option]);
+                if (e != CMDLINE_OK)
+                    return e;
+                if (o.type == ARG_INT)
+                    r.intArg[option] = (int)r.value[option].i;
+            }
+            return CMDLINE_OK;
+        }, error);
+        if (!ret)
+        {
+            int shortname = error.option >= 0 && Specs[error.option].shortname ? Specs[error.option].shortname : NO_SHORTNAME;
+            printParseError (error, shortname, error.option >= 0 ? Specs[error.option].longname : nullptr);
+        }
+
+        // first check whether options like --help or --version are set. If yes, we don't fail if mandatory options are missing
+        bool enforceMandatoryOptions = true;
+        for (size_t n = 0; n < size; n++)
+        {
+            if (Specs[n].dontFailIfSet && r.isSet[n])
+                enforceMandatoryOptions = false;
+        }
+        for (size_t n = 0; enforceMandatoryOptions && n < size; n++)
+        {
+            if (!Specs[n].optional && !r.isSet[n])
+            {
+                Console::PrintError ("mandatory option -%c --%s not set\n", Specs[n].shortname, Specs[n].longname);
+                ret = false;
+            }
+        }
+
+        if (optind)
+            *optind = index;
+        return ret;
+    }
+
+private:
+    static constexpr size_t longCount = cmdlineSchema::countLongnames (Specs);
+
+    static constexpr std::array<char, size * 2 + 1> makeShortopts ()
+    {
+        std::array<char, size * 2 + 1> s {};
+        size_t pos = 0;
+        for (size_t n = 0; n < size; n++)
+        {
+            if (Specs[n].shortname)
+            {
+                s[pos++] = Specs[n].shortname;
+                if (Specs[n].argname)
+                    s[pos++] = ':';
+            }
+        }
+        s[pos] = '\0';
+        return s;
+    }
+
+    static constexpr std::array<ko_longopt_t, longCount + 1> makeLongopts ()
+    {
+        std::array<ko_longopt_t, longCount + 1> l {};
+        size_t pos = 0;
+        for (size_t n = 0; n < size; n++)
+        {
+            if (Specs[n].longname)
+            {
+                int hasArg = ko_no_argument;
+                if (Specs[n].argname)
+                    hasArg = Specs[n].hasOptionalArg ? ko_optional_argument : ko_required_argument;
+                l[pos++] = ko_longopt_t {Specs[n].longname, hasArg, cmdlineSchema::optionId (Specs[n], n)};
+            }
+        }
+        l[pos] = ko_longopt_t {nullptr, 0, 0};
+        return l;
+    }
+
+    static constexpr std::array<int, NO_SHORTNAME + size> makeDispatch ()
+    {
+        std::array<int, NO_SHORTNAME + size> d {};
+        for (size_t n = 0; n < d.size (); n++)
+            d[n] = -1;
+        for (size_t n = 0; n < size; n++)
+        {
+            int id = cmdlineSchema::optionId (Specs[n], n);
+            d[id < NO_SHORTNAME ? (unsigned char)id : (unsigned)id] = (int)n;
+        }
+        return d;
+    }
+
+    // indices into longopts, sorted by name
+    static constexpr std::array<int, longCount> makeSortedLongopts ()
+    {
+        std::array<int, longCount> s {};
+        for (size_t n = 0; n < longCount; n++)
+        {
+            size_t k = n;
+            for (; k > 0 && cmdlineSchema::less (longopts[n].name, longopts[s[k - 1]].name); k--)
+                s[k] = s[k - 1];
+            s[k] = (int)n;
+        }
+        return s;
+    }
+
+    static constexpr std::array<char, size * 2 + 1> shortopts = makeShortopts ();
+    static constexpr std::array<ko_longopt_t, longCount + 1> longopts = makeLongopts ();
+    static constexpr std::array<int, NO_SHORTNAME + size> dispatch = makeDispatch ();
+    static constexpr std::array<int, longCount> sortedLongopts = makeSortedLongopts ();
+
+    // binary search in sortedLongopts, same results as ko_longopt_scan (names are unique)
+    static int lookupLongOption (const void*, const ko_longopt_t* l, const char* name, int len)
+    {
+        size_t lo = 0;
+        size_t hi = longCount;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (strncmp (l[sortedLongopts[mid]].name, name, len) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        // 'lo' is the first name starting with 'name'; an exact match is always sorted before its extensions
+        if (lo == longCount || strncmp (l[sortedLongopts[lo]].name, name, len))
+            return -1;
+        if (l[sortedLongopts[lo]].name[len] == '\0')
+            return sortedLongopts[lo];
+        if (lo + 1 < longCount && !strncmp (l[sortedLongopts[lo + 1]].name, name, len))
+            return -2;
+        return sortedLongopts[lo];
+    }
+};
+
+#endif /* CMDLINESCHEMA_HPP_ */
@@ -17,17 +17,255 @@
  */
 
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdio>
-#include <sstream>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <string>
+#include <vector>
+#ifndef HAVE_WINDOWS
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
 
 #include "console.hpp"
+#include "consolering.hpp"
+#include "consolesink.hpp"
 #include "bug.hpp"
 
-Console::out_level Console::level = Normal;
-#ifdef MT_CONSOLE
-    std::mutex Console::mtx;
-#endif
+std::atomic<Console::out_level> Console::level (Normal);
+std::atomic<bool> Console::statsActive (false);
+
+// where the output goes, see SetSink
+// the default sink is never destroyed, prints of global destructors and atexit handlers come after that
+union stderrSinkStorage
+{
+    cStderrSink sink;
+    constexpr stderrSinkStorage () : sink ()
+    {
+    }
+    ~stderrSinkStorage ()
+    {
+    }
+};
+static stderrSinkStorage stderrSink;
+static std::atomic<cConsoleSink*> sink (&stderrSink.sink);
+// serializes sinks that are not concurrent
+static std::mutex sinkMtx;
+
+// per thread, so formatting needs neither a lock nor, once grown, the heap
+static thread_local char formatBuffer[1024];
+// set when 'largeBuffer' is destroyed; prints of atexit handlers and global destructors come after that
+static thread_local bool largeBufferRetired = false;
+struct cLargeBuffer : std::vector<char>
+{
+    ~cLargeBuffer ()
+    {
+        largeBufferRetired = true;
+    }
+};
+static thread_local cLargeBuffer largeBuffer;
+
+// Statistics, see EnableStats. Only the owning thread writes its counters; relaxed atomics let GetStats read them
+// while they change. Counters of threads that ended are added to 'retiredStats'.
+struct threadStats
+{
+    std::atomic<uint64_t> printed[8];
+    std::atomic<uint64_t> filtered[8];
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> writeNs;
+    std::atomic<uint64_t> maxWriteNs;
+
+    threadStats ();
+    ~threadStats ();
+    static void add (std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store (counter.load (std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    void addTo (consoleStats& total) const;
+};
+
+static std::mutex statsMtx;
+static consoleStats retiredStats;
+static std::vector<threadStats*>& statsList ()
+{
+    static std::vector<threadStats*>* list = new std::vector<threadStats*> ();
+    return *list;
+}
+static thread_local threadStats* currentStats = nullptr;
+// set when the counters of the thread are destroyed; the main thread's are gone before the atexit handlers print
+static thread_local bool statsRetired = false;
+
+// nullptr once the counters of the calling thread are destroyed, it then counts into 'retiredStats'
+static threadStats* ownStats ()
+{
+    if (!currentStats && !statsRetired)
+    {
+        static thread_local threadStats stats;
+        currentStats = &stats;
+    }
+    return currentStats;
+}
+
+// state of the asynchronous console, see StartAsync
+static cConsoleRing asyncRing;
+static std::vector<char> asyncBatch;
+static std::atomic<bool> asyncActive (false);
+static std::atomic<bool> asyncStop (false);
+static std::atomic<bool> writerSleeping (false);
+static std::atomic<unsigned long> asyncDropped (0);
+static Console::overflow_policy asyncPolicy = Console::Block;
+static std::thread asyncWriter;
+// serializes StartAsync and StopAsync
+static std::mutex asyncControl;
+// only used to let the writer sleep while there is nothing to do
+static std::mutex asyncSleepMtx;
+static std::condition_variable asyncWakeup;
+
+
+static bool writeOut (const char* text, size_t len)
+{
+    cConsoleSink* current = sink.load (std::memory_order_acquire);
+    if (current->concurrent ())
+        return current->write (text, len);
+    std::lock_guard<std::mutex> lock (sinkMtx);
+    return sink.load (std::memory_order_relaxed)->write (text, len);
+}
+
+static void flushSink ()
+{
+    std::lock_guard<std::mutex> lock (sinkMtx);
+    sink.load (std::memory_order_relaxed)->flush ();
+}
+
+// Formats into the buffers of the calling thread, or into 'late' once they are destroyed. Returns the length or -1;
+// 'text' is the result.
+static int formatMessage (const char*& text, const char* format, va_list ap, std::vector<char>& late)
+{
+    va_list copy;
+    va_copy (copy, ap);
+
+    text = formatBuffer;
+    int len = vsnprintf (formatBuffer, sizeof (formatBuffer), format, ap);
+    if (len >= (int)sizeof (formatBuffer))
+    {
+        try
+        {
+            std::vector<char>& buffer = largeBufferRetired ? late : largeBuffer;
+            if (buffer.size () <= (size_t)len)
+                buffer.resize ((size_t)len + 1);
+            vsnprintf (buffer.data (), buffer.size (), format, copy);
+            text = buffer.data ();
+        }
+        catch (const std::bad_alloc&)
+        {
+            len = -1;
+        }
+    }
+    va_end (copy);
+    return len;
+}
+
+// background thread: writes everything in the ring in as few writes as possible
+static void asyncWriterLoop ()
+{
+    for (;;)
+    {
+        size_t len = asyncRing.pop (asyncBatch.data (), asyncBatch.size ());
+        if (len)
+        {
+            writeOut (asyncBatch.data (), len);
+            continue;
+        }
+        if (asyncStop)
+        {
+            if (asyncRing.empty ())
+                break;
+            // a producer is still copying its record
+            std::this_thread::yield ();
+            continue;
+        }
+
+        // idle: buffering sinks don't have to wait for their timeout
+        flushSink ();
+        std::unique_lock<std::mutex> lock (asyncSleepMtx);
+        writerSleeping = true;
+        // the timeout covers a producer that checked writerSleeping just before it was set
+        if (asyncRing.empty () && !asyncStop)
+            asyncWakeup.wait_for (lock, std::chrono::milliseconds (10));
+        writerSleeping = false;
+    }
+}
+
+static void wakeWriter ()
+{
+    if (writerSleeping)
+        asyncWakeup.notify_one ();
+}
+
+static bool queueAsync (const char* text, size_t len)
+{
+    if (len > asyncRing.maxRecord ())
+    {
+        // doesn't fit at all, but must not overtake what is pending
+        Console::Flush ();
+        return writeOut (text, len);
+    }
+    while (!asyncRing.push (text, len))
+    {
+        if (asyncPolicy == Console::Drop)
+        {
+            asyncDropped++;
+            return false;
+        }
+        if (!asyncActive)
+            return writeOut (text, len);
+        wakeWriter ();
+        std::this_thread::yield ();
+    }
+    wakeWriter ();
+    return true;
+}
+
+// BUG is about to abort: give the writer a moment to write what is pending, then flush the sink
+static void flushBeforeAbort ()
+{
+    if (asyncActive && std::this_thread::get_id () != asyncWriter.get_id ())
+    {
+        size_t mark = asyncRing.mark ();
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now () + std::chrono::seconds (1);
+        while (!asyncRing.reached (mark) && std::chrono::steady_clock::now () < deadline)
+        {
+            wakeWriter ();
+            std::this_thread::yield ();
+        }
+    }
+    // BUG may have been hit while the sink was in use
+    std::unique_lock<std::mutex> lock (sinkMtx, std::try_to_lock);
+    if (lock.owns_lock ())
+        sink.load (std::memory_order_relaxed)->flush ();
+}
+
+static void flushAtExit ()
+{
+    Console::StopAsync ();
+    flushSink ();
+}
+
+static void registerFlush ()
+{
+    static bool atExitRegistered = false;
+    if (!atExitRegistered)
+        atExitRegistered = !std::atexit (flushAtExit);
+    bugExitHook () = flushBeforeAbort;
+}
 
 
 void Console::SetPrintLevel (out_level lvl)
@@ -52,13 +290,8 @@ int Console::Print (const char* format, ...)
     int ret;
     va_list args;
     va_start (args, format);
-#ifdef MT_CONSOLE
-    mtx.lock();
-#endif
+
     ret = Console::print (Console::Normal, format, args);
-#ifdef MT_CONSOLE
-    mtx.unlock();
-#endif
 
     va_end (args);
     return ret;
@@ -108,40 +341,211 @@ int Console::PrintDebug (const char* format, ...)
     return ret;
 }
 
-void Console::PrintWrapedText(const char* text, size_t lineWidth, size_t firstIndent, size_t otherIndent)
+int Console::PrintAt (out_level lvl, const char* format, ...)
 {
-    std::istringstream words(text);
-    std::string word;
-    bool isFirstLine = true;
-    std::string line(firstIndent, ' ');
+    int ret;
+    va_list args;
+    va_start (args, format);
 
-    while (words >> word)
+    ret = Console::print (lvl, format, args);
+
+    va_end (args);
+    return ret;
+}
+
+// display width of one character: combining marks and zero width characters take none, East Asian wide ones two
+static int charWidth (uint32_t c)
+{
+    static const uint32_t zero[][2] = {
+        {0x0300, 0x036f}, {0x0483, 0x0489}, {0x0591, 0x05bd}, {0x0610, 0x061a}, {0x064b, 0x065f}, {0x0e31, 0x0e31},
+        {0x0e34, 0x0e3a}, {0x0e47, 0x0e4e}, {0x1ab0, 0x1aff}, {0x1dc0, 0x1dff}, {0x200b, 0x200f}, {0x202a, 0x202e},
+        {0x2060, 0x2064}, {0x20d0, 0x20ff}, {0xfe00, 0xfe0f}, {0xfe20, 0xfe2f}, {0xfeff, 0xfeff}, {0xe0100, 0xe01ef}};
+    static const uint32_t wide[][2] = {
+        {0x1100, 0x115f}, {0x231a, 0x231b}, {0x2329, 0x232a}, {0x23e9, 0x23ec}, {0x23f0, 0x23f0}, {0x23f3, 0x23f3},
+        {0x25fd, 0x25fe}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267f, 0x267f}, {0x2693, 0x2693}, {0x26a1, 0x26a1},
+        {0x26aa, 0x26ab}, {0x26bd, 0x26be}, {0x26c4, 0x26c5}, {0x26ce, 0x26ce}, {0x26d4, 0x26d4}, {0x26ea, 0x26ea},
+        {0x26f2, 0x26f3}, {0x26f5, 0x26f5}, {0x26fa, 0x26fa}, {0x26fd, 0x26fd}, {0x2705, 0x2705}, {0x270a, 0x270b},
+        {0x2728, 0x2728}, {0x274c, 0x274c}, {0x274e, 0x274e}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+        {0x27b0, 0x27b0}, {0x27bf, 0x27bf}, {0x2b1b, 0x2b1c}, {0x2b50, 0x2b50}, {0x2b55, 0x2b55}, {0x2e80, 0x303e},
+        {0x3041, 0x33ff}, {0x3400, 0x4dbf}, {0x4e00, 0x9fff}, {0xa000, 0xa4cf}, {0xa960, 0xa97f}, {0xac00, 0xd7a3},
+        {0xf900, 0xfaff}, {0xfe10, 0xfe19}, {0xfe30, 0xfe6f}, {0xff00, 0xff60}, {0xffe0, 0xffe6}, {0x16fe0, 0x18aff},
+        {0x1b000, 0x1b2ff}, {0x1f004, 0x1f004}, {0x1f0cf, 0x1f0cf}, {0x1f18e, 0x1f18e}, {0x1f191, 0x1f19a},
+        {0x1f200, 0x1f251}, {0x1f300, 0x1f64f}, {0x1f680, 0x1f6ff}, {0x1f900, 0x1f9ff}, {0x1fa70, 0x1faff},
+        {0x20000, 0x3fffd}};
+
+    if (c < 0x300)
+        return 1;
+    for (const auto& range : zero)
     {
-        bool linebreak = false;
-        if (word == "</br>")
+        if (c >= range[0] && c <= range[1])
+            return 0;
+    }
+    for (const auto& range : wide)
+    {
+        if (c >= range[0] && c <= range[1])
+            return 2;
+    }
+    return 1;
+}
+
+size_t Console::DisplayWidth (const char* text, size_t len)
+{
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + len;
+    size_t width = 0;
+    while (p < end)
+    {
+        // ASCII needs no decoding
+        if (*p < 0x80)
         {
-            linebreak = true;
-            word = "";
+            width++;
+            p++;
+            continue;
         }
-        if (linebreak || line.length() + word.length() + 1 > lineWidth)
+        int follow = *p >= 0xf0 && *p < 0xf8 ? 3 : *p >= 0xe0 ? 2 : *p >= 0xc0 ? 1 : 0;
+        if (*p >= 0xf8 || !follow || end - p <= follow)
         {
-            Console::Print ("%s\n", line.c_str());
-            line = std::string(otherIndent, ' ') + word;
-            isFirstLine = false;
+            // not UTF-8, one column per byte
+            width++;
+            p++;
+            continue;
         }
-        else
+        uint32_t c = *p & (0x3f >> follow);
+        int n = 1;
+        for (; n <= follow && (p[n] & 0xc0) == 0x80; n++)
+            c = c << 6 | (p[n] & 0x3f);
+        if (n <= follow)
         {
-            if (line.length() > (isFirstLine ? firstIndent : otherIndent))
+            width++;
+            p++;
+            continue;
+        }
+        width += (size_t)charWidth (c);
+        p += n;
+    }
+    return width;
+}
+
+void Console::WrapText (std::string& out, const char* text, size_t lineWidth, size_t firstIndent, size_t otherIndent)
+{
+    // Writes behind 'used' and grows 'out' in steps, which is much cheaper than appending every word. Each step
+    // only adds (and zero-fills) what the next words need, the capacity grows geometrically, so appending to a long
+    // text stays linear.
+    const size_t STEP = 4096;
+    size_t used = out.size ();
+    auto reserve = [&out, &used](size_t len) -> char*
+    {
+        if (used + len > out.size ())
+        {
+            if (used + len + STEP > out.capacity ())
+                out.reserve (out.capacity () * 2 > used + len + STEP ? out.capacity () * 2 : used + len + STEP);
+            out.resize (used + len + STEP);
+        }
+        char* p = &out[used];
+        used += len;
+        return p;
+    };
+
+    try
+    {
+        // 'width' is the display width of the current line, words are separated by whitespace like for operator >>
+        size_t lineIndent = firstIndent;
+        size_t width = lineIndent;
+        bool hasWords = false;
+        memset (reserve (lineIndent), ' ', lineIndent);
+        const char* p = text;
+        for (;;)
+        {
+            while (*p == ' ' || (*p >= '\t' && *p <= '\r'))
+                p++;
+            if (!*p)
+                break;
+            const char* word = p;
+            unsigned char bits = 0;
+            while (*p && *p != ' ' && (*p < '\t' || *p > '\r'))
+                bits |= (unsigned char)*p++;
+            size_t len = (size_t)(p - word);
+            bool linebreak = len == 5 && !memcmp (word, "</br>", 5);
+            // ASCII words are as wide as they are long
+            size_t wordWidth = linebreak ? 0 : bits & 0x80 ? DisplayWidth (word, len) : len;
+
+            if (linebreak || width + wordWidth + 1 > lineWidth)
+            {
+                lineIndent = otherIndent;
+                char* line = reserve (lineIndent + 1);
+                line[0] = '\n';
+                memset (line + 1, ' ', lineIndent);
+                width    = lineIndent;
+                hasWords = false;
+                if (linebreak)
+                    continue;
+            }
+            else if (hasWords)
             {
-                line += " ";
+                *reserve (1) = ' ';
+                width++;
             }
-            line += word;
+            memcpy (reserve (len), word, len);
+            width += wordWidth;
+            hasWords = true;
         }
+        if (hasWords || lineIndent)
+            *reserve (1) = '\n';
+    }
+    catch (const std::bad_alloc&)
+    {
+        out.resize (used);
+        throw;
+    }
+    out.resize (used);
+}
+
+// per thread, so wrapping doesn't allocate once it has seen the largest text of the thread
+static thread_local bool wrapBufferRetired = false;
+struct cWrapBuffer : std::string
+{
+    ~cWrapBuffer ()
+    {
+        wrapBufferRetired = true;
+    }
+};
+static thread_local cWrapBuffer wrapBuffer;
+
+void Console::PrintWrapedText(const char* text, size_t lineWidth, size_t firstIndent, size_t otherIndent)
+{
+    if (!IsEnabled (Normal))
+    {
+        if (CONSOLE_UNLIKELY (statsActive.load (std::memory_order_relaxed)))
+            countFiltered (Normal);
+        return;
     }
-    if (!line.empty())
+
+    // a buffer of its own once the thread's is destroyed, e.g. in atexit handlers
+    std::string late;
+    std::string& buffer = wrapBufferRetired ? late : wrapBuffer;
+    try
     {
-        Console::Print ("%s\n", line.c_str());
+        buffer.clear ();
+        WrapText (buffer, text, lineWidth, firstIndent, otherIndent);
     }
+    catch (const std::bad_alloc&)
+    {
+        Console::PrintError ("Not enough memory\n");
+        return;
+    }
+    write (Normal, buffer.data (), buffer.size ());
+}
+
+size_t Console::TerminalWidth ()
+{
+#ifdef HAVE_WINDOWS
+    return 0;
+#else
+    struct winsize ws;
+    if (ioctl (STDERR_FILENO, TIOCGWINSZ, &ws) < 0)
+        return 0;
+    return ws.ws_col;
+#endif
 }
 
 void Console::Clear ()
@@ -150,13 +554,506 @@ void Console::Clear ()
     Console::Print ("%c[H", (char)27);
 }
 
+bool Console::StartAsync (size_t bufferSize, overflow_policy policy)
+{
+    StopAsync ();
+
+    std::lock_guard<std::mutex> lock (asyncControl);
+    if (!asyncRing.init (bufferSize))
+        return false;
+    try
+    {
+        size_t batch = asyncRing.maxRecord () < 64 * 1024 ? 64 * 1024 : asyncRing.maxRecord ();
+        asyncBatch.resize (batch);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
+    }
+
+    asyncPolicy = policy;
+    asyncStop   = false;
+    try
+    {
+        asyncWriter = std::thread (asyncWriterLoop);
+    }
+    catch (const std::system_error&)
+    {
+        return false;
+    }
+
+    registerFlush ();
+    asyncActive.store (true, std::memory_order_release);
+    return true;
+}
+
+void Console::StopAsync ()
+{
+    std::lock_guard<std::mutex> lock (asyncControl);
+    if (!asyncWriter.joinable ())
+        return;
+
+    // new prints are written directly, the writer leaves as soon as the ring is empty
+    asyncActive = false;
+    asyncStop   = true;
+    asyncWakeup.notify_one ();
+    asyncWriter.join ();
+
+    // anything that was queued while the writer stopped
+    size_t len;
+    while ((len = asyncRing.pop (asyncBatch.data (), asyncBatch.size ())) > 0)
+        writeOut (asyncBatch.data (), len);
+}
+
+void Console::Flush ()
+{
+    // other threads may keep printing, only wait for what is pending now
+    size_t mark = asyncRing.mark ();
+    while (asyncActive && !asyncRing.reached (mark))
+    {
+        wakeWriter ();
+        std::this_thread::yield ();
+    }
+    flushSink ();
+}
+
+unsigned long Console::DroppedMessages ()
+{
+    return asyncDropped;
+}
+
+void Console::SetSink (cConsoleSink* newSink)
+{
+    Flush ();
+    {
+        std::lock_guard<std::mutex> lock (sinkMtx);
+        sink.load (std::memory_order_relaxed)->flush ();
+        sink.store (newSink ? newSink : &stderrSink.sink, std::memory_order_release);
+    }
+    if (newSink)
+        registerFlush ();
+}
+
+threadStats::threadStats ()
+{
+    for (int n = 0; n < 8; n++)
+    {
+        printed[n]  = 0;
+        filtered[n] = 0;
+    }
+    bytes      = 0;
+    writeNs    = 0;
+    maxWriteNs = 0;
+    std::lock_guard<std::mutex> lock (statsMtx);
+    try
+    {
+        statsList ().push_back (this);
+    }
+    catch (const std::bad_alloc&)
+    {
+        // this thread's counters are only seen once it ends
+    }
+}
+
+threadStats::~threadStats ()
+{
+    std::lock_guard<std::mutex> lock (statsMtx);
+    std::vector<threadStats*>& list = statsList ();
+    for (size_t n = 0; n < list.size (); n++)
+    {
+        if (list[n] == this)
+        {
+            list[n] = list.back ();
+            list.pop_back ();
+            break;
+        }
+    }
+    addTo (retiredStats);
+    currentStats = nullptr;
+    statsRetired = true;
+}
+
+void threadStats::addTo (consoleStats& total) const
+{
+    for (int n = 0; n < 8; n++)
+    {
+        total.printed[n]  += printed[n].load (std::memory_order_relaxed);
+        total.filtered[n] += filtered[n].load (std::memory_order_relaxed);
+    }
+    total.bytes   += bytes.load (std::memory_order_relaxed);
+    total.writeNs += writeNs.load (std::memory_order_relaxed);
+    uint64_t max = maxWriteNs.load (std::memory_order_relaxed);
+    if (max > total.maxWriteNs)
+        total.maxWriteNs = max;
+}
+
+static void printStats (const consoleStats& stats)
+{
+    static const char* names[8] = {"", "silent", "error", "normal", "verbose", "more verbose", "most verbose", "debug"};
+    fprintf (stderr, "console statistics:\n%-14s %14s %14s\n", "level", "printed", "filtered");
+    for (int n = Console::Error; n <= Console::Debug; n++)
+    {
+        fprintf (stderr, "%-14s %14llu %14llu\n", names[n], (unsigned long long)stats.printed[n],
+            (unsigned long long)stats.filtered[n]);
+    }
+    fprintf (stderr, "%llu bytes written in %.3f ms, longest write %.3f ms\n", (unsigned long long)stats.bytes,
+        stats.writeNs / 1e6, stats.maxWriteNs / 1e6);
+}
+
+static void printStatsAtExit ()
+{
+    Console::Flush ();
+    printStats (Console::GetStats ());
+}
+
+void Console::EnableStats (bool enable, bool dumpAtExit)
+{
+    statsActive = enable;
+    static std::atomic<bool> atExitRegistered (false);
+    if (dumpAtExit && !atExitRegistered.exchange (true))
+        std::atexit (printStatsAtExit);
+}
+
+consoleStats Console::GetStats ()
+{
+    std::lock_guard<std::mutex> lock (statsMtx);
+    consoleStats total = retiredStats;
+    for (const threadStats* stats : statsList ())
+        stats->addTo (total);
+    return total;
+}
+
+void Console::countFiltered (out_level lvl)
+{
+    threadStats* stats = ownStats ();
+    if (stats)
+    {
+        threadStats::add (stats->filtered[lvl], 1);
+        return;
+    }
+    std::lock_guard<std::mutex> lock (statsMtx);
+    retiredStats.filtered[lvl]++;
+}
+
 int Console::print (out_level lvl, const char* format, va_list ap)
 {
-    if (lvl > level)
+    if (!IsEnabled (lvl))
+    {
+        if (CONSOLE_UNLIKELY (statsActive.load (std::memory_order_relaxed)))
+            countFiltered (lvl);
         return false;
+    }
 
-     // we always print to stderr to be able to separate piped in/output from console prints
-    int ret = vfprintf (stderr, format, ap) >= 0;
-    fflush (stderr);
-    return ret;
+    const char* text;
+    std::vector<char> late;
+    int len = formatMessage (text, format, ap, late);
+    if (len < 0)
+        return false;
+    return write (lvl, text, (size_t)len);
+}
+
+int Console::Write (out_level lvl, const char* text, size_t len)
+{
+    if (!IsEnabled (lvl))
+    {
+        if (CONSOLE_UNLIKELY (statsActive.load (std::memory_order_relaxed)))
+            countFiltered (lvl);
+        return false;
+    }
+    return write (lvl, text, len);
+}
+
+int Console::write (out_level lvl, const char* text, size_t len)
+{
+    if (CONSOLE_UNLIKELY (statsActive.load (std::memory_order_relaxed)))
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+        int ret = asyncActive.load (std::memory_order_acquire) ? queueAsync (text, len) : writeOut (text, len);
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now () - start).count ();
+
+        threadStats* stats = ownStats ();
+        if (stats)
+        {
+            threadStats::add (stats->printed[lvl], 1);
+            threadStats::add (stats->bytes, len);
+            threadStats::add (stats->writeNs, ns);
+            if (ns > stats->maxWriteNs.load (std::memory_order_relaxed))
+                stats->maxWriteNs.store (ns, std::memory_order_relaxed);
+            return ret;
+        }
+        std::lock_guard<std::mutex> lock (statsMtx);
+        retiredStats.printed[lvl]++;
+        retiredStats.bytes += len;
+        retiredStats.writeNs += ns;
+        if (ns > retiredStats.maxWriteNs)
+            retiredStats.maxWriteNs = ns;
+        return ret;
+    }
+
+    if (asyncActive.load (std::memory_order_acquire))
+        return queueAsync (text, len);
+
+    // by default we print to stderr to be able to separate piped in/output from console prints
+    return writeOut (text, len);
+}
+
+
+#ifdef WITH_UNITTESTS
+void Console::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+    {
+        // output goes to the sink, synchronously and asynchronously, until stderr is restored
+        cMemorySink memory;
+        char out[1024];
+        // debug output is dropped if it is not compiled in
+        const size_t debugLen = CONSOLE_MIN_LEVEL >= Debug ? 601 : 0;
+        BUG_IF_NOT (memory.init (sizeof (out)));
+        SetSink (&memory);
+        Console::Print ("%s %d\n", "sync", 1);
+        Console::PrintDebug ("%s\n", std::string (600, 'x').c_str ());
+        BUG_IF_NOT (StartAsync (4096, Block));
+        Console::Print ("async %d\n", 2);
+        Flush ();
+        BUG_IF_NOT (memory.read (out, sizeof (out)) == 7 + debugLen + 8);
+        BUG_IF_NOT (!memcmp (out, "sync 1\n", 7) && !memcmp (out + 7 + debugLen, "async 2\n", 8));
+        StopAsync ();
+        SetSink (nullptr);
+        Console::PrintDebug ("-- sink restored --\n");
+        BUG_IF_NOT (memory.read (out, sizeof (out)) == 7 + debugLen + 8);
+    }
+    {
+        // arguments of disabled output are not evaluated
+        cMemorySink memory;
+        char out[64];
+        int evaluated = 0;
+        BUG_IF_NOT (memory.init (sizeof (out)));
+        SetSink (&memory);
+        SetPrintLevel (Verbose);
+        CONSOLE_DEBUG ("%d\n", ++evaluated);
+        CONSOLE_MORE_VERBOSE ("%d\n", ++evaluated);
+        CONSOLE_VERBOSE ("%d\n", ++evaluated);
+        CONSOLE_PRINT ("%d\n", ++evaluated);
+        BUG_IF_NOT (IsEnabled (Error) && !IsEnabled (MoreVerbose));
+        BUG_IF_NOT (IsEnabled (Verbose) == (CONSOLE_MIN_LEVEL >= Verbose));
+        SetPrintLevel (Debug);
+        SetSink (nullptr);
+#if CONSOLE_MIN_LEVEL >= 4
+        BUG_IF_NOT (evaluated == 2);
+        BUG_IF_NOT (memory.read (out, sizeof (out)) == 4 && !memcmp (out, "1\n2\n", 4));
+#else
+        // CONSOLE_VERBOSE is compiled out
+        BUG_IF_NOT (evaluated == 1);
+        BUG_IF_NOT (memory.read (out, sizeof (out)) == 2 && !memcmp (out, "1\n", 2));
+#endif
+    }
+
+    {
+        // display width of UTF-8: umlauts take one column, CJK two, combining marks none, invalid bytes one
+        BUG_IF_NOT (DisplayWidth ("abc", 3) == 3);
+        BUG_IF_NOT (DisplayWidth ("\xc3\xa4\xc3\xb6\xc3\xbc", 6) == 3);
+        BUG_IF_NOT (DisplayWidth ("\xe6\x97\xa5\xe6\x9c\xac", 6) == 4);
+        BUG_IF_NOT (DisplayWidth ("e\xcc\x81", 3) == 1);
+        BUG_IF_NOT (DisplayWidth ("\xf0\x9f\x98\x80", 4) == 2);
+        BUG_IF_NOT (DisplayWidth ("\xff\xc3", 2) == 2);
+        BUG_IF_NOT (DisplayWidth ("\xe6\x97", 2) == 2);
+
+        // wrapping in one write
+        cMemorySink memory;
+        char out[1024];
+        BUG_IF_NOT (memory.init (sizeof (out)));
+        SetSink (&memory);
+        PrintWrapedText ("  one two\tthree\nfour five </br> six  seventeen-characters x", 13, 2, 4);
+        size_t len = memory.read (out, sizeof (out));
+        const char* expected = "  one two\n    three\n    four five\n    six\n    seventeen-characters\n    x\n";
+        BUG_IF_NOT (len == strlen (expected) && !memcmp (out, expected, len));
+
+        // 10 columns, although more bytes
+        BUG_IF_NOT (memory.init (sizeof (out)));
+        PrintWrapedText ("\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4 \xe6\x97\xa5\xe6\x97\xa5 wrapped", 10);
+        len = memory.read (out, sizeof (out));
+        expected = "\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4 \xe6\x97\xa5\xe6\x97\xa5\nwrapped\n";
+        BUG_IF_NOT (len == strlen (expected) && !memcmp (out, expected, len));
+
+        BUG_IF_NOT (memory.init (sizeof (out)));
+        PrintWrapedText (" \n ", 10);
+        BUG_IF_NOT (memory.read (out, sizeof (out)) == 0);
+        SetSink (nullptr);
+    }
+    {
+        // statistics of all threads, including ended ones
+        cMemorySink memory;
+        BUG_IF_NOT (memory.init (1024));
+        SetSink (&memory);
+        consoleStats before = GetStats ();
+        EnableStats ();
+        std::thread worker ([]()
+        {
+            // destroyed after the counters of the thread, as the atexit handlers run after those of the main thread
+            struct cLatePrint
+            {
+                ~cLatePrint ()
+                {
+                    Console::Print ("late\n");
+                }
+            };
+            static thread_local cLatePrint late;
+            (void)late;
+            Console::PrintError ("%s\n", "error");
+            CONSOLE_VERBOSE ("%d\n", 4);
+        });
+        worker.join ();
+        SetPrintLevel (Normal);
+        Console::Print ("12345\n");
+        CONSOLE_DEBUG ("not printed\n");
+        Console::PrintMostVerbose ("not printed\n");
+        SetPrintLevel (Debug);
+        consoleStats after = GetStats ();
+        EnableStats (false);
+        Console::Print ("not counted\n");
+        SetSink (nullptr);
+
+        // macros below CONSOLE_MIN_LEVEL are compiled out and count nothing, the Print functions count them as filtered
+        const uint64_t verbose = CONSOLE_MIN_LEVEL >= Verbose ? 1 : 0;
+        const uint64_t debug = CONSOLE_MIN_LEVEL >= Debug ? 1 : 0;
+        BUG_IF_NOT (after.printed[Error] - before.printed[Error] == 1);
+        BUG_IF_NOT (after.printed[Verbose] - before.printed[Verbose] == verbose);
+        BUG_IF_NOT (after.printed[Normal] - before.printed[Normal] == 2);
+        BUG_IF_NOT (after.filtered[Debug] - before.filtered[Debug] == debug);
+        BUG_IF_NOT (after.filtered[MostVerbose] - before.filtered[MostVerbose] == 1);
+        BUG_IF_NOT (after.bytes - before.bytes == 6 + 2 * verbose + 5 + 6);
+        BUG_IF_NOT (after.maxWriteNs > 0 && after.writeNs >= after.maxWriteNs);
+        BUG_IF_NOT (GetStats ().printed[Normal] == after.printed[Normal]);
+    }
+    {
+        // long and wrapped messages after the buffers of the thread are destroyed
+        cMemorySink memory;
+        std::vector<char> out (8192);
+        BUG_IF_NOT (memory.init (out.size ()));
+        SetSink (&memory);
+        std::thread worker ([]()
+        {
+            struct cLatePrint
+            {
+                ~cLatePrint ()
+                {
+                    Console::Print ("%s\n", std::string (3000, 'l').c_str ());
+                    PrintWrapedText ("late wrapped", 8);
+                }
+            };
+            static thread_local cLatePrint late;
+            (void)late;
+            Console::Print ("%s\n", std::string (2000, 'e').c_str ());
+            PrintWrapedText ("early", 8);
+        });
+        worker.join ();
+        SetSink (nullptr);
+        std::string expected = std::string (2000, 'e') + "\nearly\n" + std::string (3000, 'l') + "\nlate\nwrapped\n";
+        BUG_IF_NOT (memory.read (out.data (), out.size ()) == expected.size () &&
+            !memcmp (out.data (), expected.data (), expected.size ()));
+    }
+
+#ifndef HAVE_WINDOWS
+    {
+        // synchronous output of many threads: every line arrives in one piece and in order
+        char path[] = "/tmp/cmdline-unittest-XXXXXX";
+        int fd = mkstemp (path);
+        BUG_IF_NOT (fd >= 0);
+        int saved = dup (2);
+        BUG_IF_NOT (saved >= 0 && dup2 (fd, 2) == 2);
+
+        const int THREADS = 64;
+        const int LINES = 500;
+        const std::string large (3000, 'x');
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++)
+        {
+            threads.emplace_back ([t, &large]()
+            {
+                for (int n = 0; n < LINES; n++)
+                    CONSOLE_PRINT ("%d %d %s\n", t, n, n % 50 ? "" : large.c_str ());
+            });
+        }
+        for (auto& thread : threads)
+            thread.join ();
+
+        BUG_IF_NOT (dup2 (saved, 2) == 2);
+        close (saved);
+
+        FILE* f = fdopen (fd, "r");
+        BUG_IF_NOT (f && !fseek (f, 0, SEEK_SET));
+        std::vector<int> next (THREADS, 0);
+        int lines = 0;
+        int t, n;
+        char line[8192];
+        char expected[8192];
+        while (fgets (line, sizeof (line), f))
+        {
+            BUG_IF_NOT (sscanf (line, "%d %d", &t, &n) == 2);
+            BUG_IF_NOT (t >= 0 && t < THREADS && n == next[t]);
+            snprintf (expected, sizeof (expected), "%d %d %s\n", t, n, n % 50 ? "" : large.c_str ());
+            BUG_IF_NOT (!strcmp (line, expected));
+            next[t]++;
+            lines++;
+        }
+        fclose (f);
+        unlink (path);
+        BUG_IF_NOT (lines == THREADS * LINES);
+    }
+
+    // all output of several threads must arrive, each thread's lines in order
+    char path[] = "/tmp/cmdline-unittest-XXXXXX";
+    int fd = mkstemp (path);
+    BUG_IF_NOT (fd >= 0);
+    int saved = dup (2);
+    BUG_IF_NOT (saved >= 0 && dup2 (fd, 2) == 2);
+
+    const int THREADS = 4;
+    const int LINES = 5000;
+    BUG_IF_NOT (StartAsync (4096, Block));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back ([t]()
+        {
+            for (int n = 0; n < LINES; n++)
+                Console::Print ("%d %d %s\n", t, n, n % 100 ? "" : std::string (5000, 'x').c_str ());
+        });
+    }
+    for (auto& thread : threads)
+        thread.join ();
+    StopAsync ();
+
+    // with Drop, every line is either written or counted
+    unsigned long dropped = DroppedMessages ();
+    BUG_IF_NOT (StartAsync (256, Drop));
+    for (int n = 0; n < LINES; n++)
+        Console::Print ("%d %d\n", THREADS, n);
+    StopAsync ();
+    dropped = DroppedMessages () - dropped;
+
+    BUG_IF_NOT (dup2 (saved, 2) == 2);
+    close (saved);
+
+    FILE* f = fdopen (fd, "r");
+    BUG_IF_NOT (f && !fseek (f, 0, SEEK_SET));
+    int next[THREADS + 1] = {0};
+    int lines = 0;
+    int t, n;
+    char line[8192];
+    while (fgets (line, sizeof (line), f))
+    {
+        BUG_IF_NOT (sscanf (line, "%d %d", &t, &n) == 2);
+        BUG_IF_NOT (t >= 0 && t <= THREADS && n >= next[t]);
+        BUG_IF_NOT (t == THREADS || n == next[t]);
+        next[t] = n + 1;
+        lines++;
+    }
+    fclose (f);
+    unlink (path);
+    BUG_IF_NOT (lines + (int)dropped == (THREADS + 1) * LINES);
+#endif
 }
+#endif
@@ -20,11 +20,40 @@
 #ifndef CONSOLE_HPP_
 #define CONSOLE_HPP_
 
+#include <atomic>
 #include <cstdarg>
-#ifdef MT_CONSOLE
-#include <mutex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Least important level that is compiled in (1 = Silent ... 7 = Debug): the CONSOLE_* macros below compile to
+// nothing for less important output and the Print functions drop it.
+#ifndef CONSOLE_MIN_LEVEL
+#define CONSOLE_MIN_LEVEL 7
+#endif
+
+#ifdef __GNUC__
+#define CONSOLE_UNLIKELY(x) __builtin_expect (!!(x), 0)
+#else
+#define CONSOLE_UNLIKELY(x) (x)
 #endif
 
+class cConsoleSink;
+
+// counters of Console::GetStats, indexed by Console::out_level
+typedef struct
+{
+    uint64_t printed[8];
+    // dropped because of the print level
+    uint64_t filtered[8];
+    uint64_t bytes;
+    // time spent handing the messages to the sink (or to the writer thread in asynchronous mode)
+    uint64_t writeNs;
+    uint64_t maxWriteNs;
+}consoleStats;
+
+// All functions may be called by any number of threads. Each message is formatted in a per-thread buffer and
+// handed to the sink as a whole; the default sink writes it with a single write(2), so messages don't interleave.
 class Console
 {
 public:
@@ -35,19 +64,84 @@ public:
     static int PrintMostVerbose (const char* format, ...);
     static int PrintDebug (const char* format, ...);
     static void Clear ();
+    // Prints 'text' in lines of at most 'lineWidth' columns, except for words that are longer. Words are separated by
+    // whitespace, "</br>" starts a new line. Widths are display widths of UTF-8 text.
     static void PrintWrapedText(const char* text, size_t lineWidth, size_t firstIndent = 0, size_t otherIndent = 0);
+    // appends 'text' to 'out' wrapped like PrintWrapedText; throws std::bad_alloc
+    static void WrapText (std::string& out, const char* text, size_t lineWidth, size_t firstIndent = 0, size_t otherIndent = 0);
+    // number of columns 'len' bytes of UTF-8 text take on a terminal
+    static size_t DisplayWidth (const char* text, size_t len);
+    // number of columns of the terminal stderr is connected to, 0 if it is not a terminal
+    static size_t TerminalWidth ();
 
     enum out_level {Silent = 1, Error = 2, Normal = 3, Verbose = 4, MoreVerbose = 5, MostVerbose = 6, Debug = 7};
     static void SetPrintLevel (out_level lvl);
+    // like the Print functions, with the level as parameter
+    static int PrintAt (out_level lvl, const char* format, ...);
+    // prints 'text' as it is; see also CONSOLE_FORMAT (consoleformat.hpp)
+    static int Write (out_level lvl, const char* text, size_t len);
+    // true if output of level 'lvl' is printed; verbose and debug output is expected to be off
+    static bool IsEnabled (out_level lvl)
+    {
+        out_level current = level.load (std::memory_order_relaxed);
+        return lvl <= CONSOLE_MIN_LEVEL && (lvl <= Normal ? lvl <= current : CONSOLE_UNLIKELY (lvl <= current));
+    }
+    // IsEnabled for the CONSOLE_* macros: counts filtered output if statistics are enabled
+    static bool ShouldPrint (out_level lvl)
+    {
+        if (lvl > CONSOLE_MIN_LEVEL)
+            return false;
+        if (IsEnabled (lvl))
+            return true;
+        if (CONSOLE_UNLIKELY (statsActive.load (std::memory_order_relaxed)))
+            countFiltered (lvl);
+        return false;
+    }
+
+    // Statistics of the console output of all threads. Each thread counts on its own, GetStats adds them up.
+    // With 'dumpAtExit' the totals are written to stderr at exit.
+    static void EnableStats (bool enable = true, bool dumpAtExit = false);
+    static consoleStats GetStats ();
+
+    // Asynchronous printing: the caller only formats, a background thread writes in batches. 'bufferSize' bytes
+    // hold the pending output. If they are used up, prints either wait (Block) or are dropped and counted (Drop).
+    // Pending output is written by StopAsync, at exit and before BUG aborts.
+    enum overflow_policy {Block, Drop};
+    static bool StartAsync (size_t bufferSize = 1024 * 1024, overflow_policy policy = Block);
+    static void StopAsync ();
+    // waits until all pending output is written
+    static void Flush ();
+    static unsigned long DroppedMessages ();
+
+    // Output goes to 'sink' instead of stderr (nullptr restores stderr), see consolesink.hpp. The sink must stay
+    // valid until it is replaced and no print can still be using it. Buffering sinks are flushed by Flush, at
+    // exit and before BUG aborts.
+    static void SetSink (cConsoleSink* sink);
+
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
 
 private:
     static int print (out_level lvl, const char* format, va_list ap);
+    static int write (out_level lvl, const char* text, size_t len);
+    static void countFiltered (out_level lvl);
 
 private:
-    static out_level level;
-#ifdef MT_CONSOLE
-    static std::mutex mtx;
-#endif
+    static std::atomic<out_level> level;
+    static std::atomic<bool> statsActive;
 };
 
+// Like the Print functions, but the arguments are only evaluated if the level is enabled. With a constant level
+// the check is inlined and calls below CONSOLE_MIN_LEVEL are removed completely.
+#define CONSOLE_PRINT_LEVEL(lvl, function, ...) \
+    do { if (Console::ShouldPrint (Console::lvl)) Console::function (__VA_ARGS__); } while (0)
+
+#define CONSOLE_ERROR(...)          CONSOLE_PRINT_LEVEL (Error, PrintError, __VA_ARGS__)
+#define CONSOLE_PRINT(...)          CONSOLE_PRINT_LEVEL (Normal, Print, __VA_ARGS__)
+#define CONSOLE_VERBOSE(...)        CONSOLE_PRINT_LEVEL (Verbose, PrintVerbose, __VA_ARGS__)
+#define CONSOLE_MORE_VERBOSE(...)   CONSOLE_PRINT_LEVEL (MoreVerbose, PrintMoreVerbose, __VA_ARGS__)
+#define CONSOLE_MOST_VERBOSE(...)   CONSOLE_PRINT_LEVEL (MostVerbose, PrintMostVerbose, __VA_ARGS__)
+#define CONSOLE_DEBUG(...)          CONSOLE_PRINT_LEVEL (Debug, PrintDebug, __VA_ARGS__)
+
 #endif /* CONSOLE_HPP_ */
@@ -0,0 +1,399 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <cstdio>
+#include <new>
+#ifdef WITH_UNITTESTS
+#include <clocale>
+#include <vector>
+#endif
+
+#include "consoleformat.hpp"
+#include "bug.hpp"
+
+
+bool cFormatBuffer::grow (size_t len)
+{
+    if (failed)
+        return false;
+    size_t newSize = size * 2 > used + len ? size * 2 : used + len;
+    char* p = new (std::nothrow) char[newSize];
+    if (!p)
+    {
+        failed = true;
+        return false;
+    }
+    memcpy (p, data, used);
+    if (data != stack)
+        delete[] data;
+    data = p;
+    size = newSize;
+    return true;
+}
+
+void cFormatBuffer::appendSigned (int64_t value)
+{
+    if (value < 0)
+    {
+        append ('-');
+        // no overflow for INT64_MIN
+        appendUnsigned (0 - (uint64_t)value);
+    }
+    else
+    {
+        appendUnsigned ((uint64_t)value);
+    }
+}
+
+void cFormatBuffer::appendUnsigned (uint64_t value)
+{
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[20];
+    char* p = digits + sizeof (digits);
+    while (value >= 100)
+    {
+        unsigned n = (unsigned)(value % 100) * 2;
+        value /= 100;
+        *--p = pairs[n + 1];
+        *--p = pairs[n];
+    }
+    if (value >= 10)
+    {
+        *--p = pairs[value * 2 + 1];
+        *--p = pairs[value * 2];
+    }
+    else
+    {
+        *--p = (char)('0' + value);
+    }
+    append (p, (size_t)(digits + sizeof (digits) - p));
+}
+
+void cFormatBuffer::appendHex (uint64_t value)
+{
+    char digits[16];
+    char* p = digits + sizeof (digits);
+    do
+    {
+        *--p = "0123456789abcdef"[value & 15];
+        value >>= 4;
+    } while (value);
+    append (p, (size_t)(digits + sizeof (digits) - p));
+}
+
+// value * 10^exp; powers up to 10^22 are exact doubles, dividing by them keeps small values accurate
+static double scale (double value, int exp)
+{
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+        1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    for (; exp > 22; exp -= 22)
+        value *= 1e22;
+    for (; exp < -22; exp += 22)
+        value /= 1e22;
+    return exp >= 0 ? value * pow10[exp] : value / pow10[-exp];
+}
+
+// Unsigned integer of up to 1280 bits, enough for the exact comparisons of roundDigits
+class cBigNumber
+{
+public:
+    explicit cBigNumber (uint64_t value)
+    {
+        limbs[0] = (uint32_t)value;
+        limbs[1] = (uint32_t)(value >> 32);
+        size = limbs[1] ? 2 : 1;
+    }
+    void multiply (uint32_t factor)
+    {
+        uint64_t carry = 0;
+        for (int n = 0; n < size; n++)
+        {
+            carry += (uint64_t)limbs[n] * factor;
+            limbs[n] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if (carry)
+        {
+            BUG_ON (size >= LIMBS);
+            limbs[size++] = (uint32_t)carry;
+        }
+    }
+    void multiplyPow5 (int exp)
+    {
+        // 5^13 is the largest power of five below 2^32
+        for (; exp >= 13; exp -= 13)
+            multiply (1220703125);
+        static const uint32_t pow5[] = {1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625, 48828125,
+            244140625};
+        multiply (pow5[exp]);
+    }
+    void shiftLeft (int bits)
+    {
+        int words = bits / 32;
+        bits %= 32;
+        BUG_ON (size + words + 1 > LIMBS);
+        limbs[size] = 0;
+        for (int n = size; n >= 0; n--)
+        {
+            uint32_t low = n > 0 && bits ? limbs[n - 1] >> (32 - bits) : 0;
+            limbs[n + words] = (bits ? limbs[n] << bits : limbs[n]) | low;
+        }
+        for (int n = 0; n < words; n++)
+            limbs[n] = 0;
+        size += words + 1;
+        while (size > 1 && !limbs[size - 1])
+            size--;
+    }
+    int compare (const cBigNumber& other) const
+    {
+        if (size != other.size)
+            return size < other.size ? -1 : 1;
+        for (int n = size - 1; n >= 0; n--)
+        {
+            if (limbs[n] != other.limbs[n])
+                return limbs[n] < other.limbs[n] ? -1 : 1;
+        }
+        return 0;
+    }
+
+private:
+    static const int LIMBS = 40;
+    uint32_t limbs[LIMBS];
+    int size;
+};
+
+// value / 10^exp rounded to an integer like printf does: to nearest, ties to even
+static uint64_t roundDigits (double value, int exp)
+{
+    double scaled = scale (value, -exp);
+    double integral = std::floor (scaled);
+    double fraction = scaled - integral;
+    uint64_t digits = (uint64_t)integral;
+
+    // scale is off by a few ulp at most, so only values next to a tie need exact arithmetic
+    if (std::fabs (fraction - 0.5) > 1e-6)
+        return fraction > 0.5 ? digits + 1 : digits;
+
+    // compare value = mantissa * 2^e with the tie (2 * digits + 1) * 5^exp * 2^(exp - 1)
+    int e;
+    double f = std::frexp (value, &e);
+    cBigNumber left ((uint64_t)std::ldexp (f, 53));
+    cBigNumber right (2 * digits + 1);
+    if (exp >= 0)
+        right.multiplyPow5 (exp);
+    else
+        left.multiplyPow5 (-exp);
+    int shift = e - 53 - (exp - 1);
+    if (shift >= 0)
+        left.shiftLeft (shift);
+    else
+        right.shiftLeft (-shift);
+
+    int c = left.compare (right);
+    return c > 0 || (c == 0 && (digits & 1)) ? digits + 1 : digits;
+}
+
+void cFormatBuffer::appendDouble (double value)
+{
+    const int PRECISION = 6;
+
+    if (std::isnan (value))
+    {
+        append (std::signbit (value) ? "-nan" : "nan", std::signbit (value) ? 4 : 3);
+        return;
+    }
+    if (std::signbit (value))
+    {
+        append ('-');
+        value = -value;
+    }
+    if (std::isinf (value))
+    {
+        append ("inf", 3);
+        return;
+    }
+    if (value == 0)
+    {
+        append ('0');
+        return;
+    }
+
+    // the PRECISION significant digits and the decimal exponent of the first one
+    int exp = (int)std::floor (std::log10 (value));
+    uint64_t digits = roundDigits (value, exp - (PRECISION - 1));
+    if (digits < 100000)
+    {
+        exp--;
+        digits = roundDigits (value, exp - (PRECISION - 1));
+    }
+    if (digits >= 1000000)
+    {
+        exp++;
+        digits = roundDigits (value, exp - (PRECISION - 1));
+        if (digits >= 1000000)
+            digits /= 10;
+    }
+
+    char text[PRECISION];
+    for (int n = PRECISION - 1; n >= 0; n--, digits /= 10)
+        text[n] = (char)('0' + digits % 10);
+    // trailing zeros are not shown
+    int len = PRECISION;
+    while (len > 1 && text[len - 1] == '0')
+        len--;
+
+    if (exp < -4 || exp >= PRECISION)
+    {
+        append (text[0]);
+        if (len > 1)
+        {
+            append ('.');
+            append (text + 1, (size_t)len - 1);
+        }
+        append (exp < 0 ? "e-" : "e+", 2);
+        if (exp > -10 && exp < 10)
+            append ('0');
+        appendUnsigned ((uint64_t)(exp < 0 ? -exp : exp));
+    }
+    else if (exp < 0)
+    {
+        append ("0.", 2);
+        for (int n = exp + 1; n < 0; n++)
+            append ('0');
+        append (text, (size_t)len);
+    }
+    else
+    {
+        append (text, (size_t)exp + 1);
+        if (len > exp + 1)
+        {
+            append ('.');
+            append (text + exp + 1, (size_t)(len - exp - 1));
+        }
+    }
+}
+
+const char* consoleFormat::appendLiteral (cFormatBuffer& out, const char* format)
+{
+    for (;;)
+    {
+        const char* brace = strpbrk (format, "{}");
+        if (!brace)
+        {
+            out.append (format, strlen (format));
+            return format + strlen (format);
+        }
+        out.append (format, (size_t)(brace - format));
+        if (brace[0] == '{' && brace[1] == '}')
+            return brace + 2;
+        // "{{" or "}}"; anything else can't pass the compile time check
+        out.append (brace[0]);
+        format = brace[1] == brace[0] ? brace + 2 : brace + 1;
+    }
+}
+
+
+#ifdef WITH_UNITTESTS
+void cFormatBuffer::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+    static_assert (consoleFormat::placeholders ("") == 0, "");
+    static_assert (consoleFormat::placeholders ("{} and {}\n") == 2, "");
+    static_assert (consoleFormat::placeholders ("{{}} {{{}}}") == 1, "");
+    static_assert (consoleFormat::placeholders ("{") == -1, "");
+    static_assert (consoleFormat::placeholders ("}") == -1, "");
+    static_assert (consoleFormat::placeholders ("{x}") == -1, "");
+
+    {
+        cFormatBuffer out;
+        std::string s ("string");
+        const char* none = nullptr;
+        int x = 0;
+        consoleFormat::formatTo (out, "{}|{}|{}|{}|{}|{}|{}|{}|{{{}}}|{}|{}|{}|{}", -42, 42u, (short)-7, (unsigned char)200,
+            INT64_MIN, UINT64_MAX, true, 'c', s, "literal", none, 0.5f, (const void*)&x);
+        char expected[256];
+        snprintf (expected, sizeof (expected), "-42|42|-7|200|-9223372036854775808|18446744073709551615|true|c|{string}|"
+            "literal|(null)|0.5|%p", (const void*)&x);
+        BUG_IF_NOT (out.length () == strlen (expected) && !memcmp (out.text (), expected, out.length ()));
+    }
+    {
+        // longer than the stack buffer
+        cFormatBuffer out;
+        std::string large (2000, 'x');
+        consoleFormat::formatTo (out, "<{}>{}", large, 7);
+        BUG_IF_NOT (!out.error () && out.length () == 2003);
+        BUG_IF_NOT (out.text ()[0] == '<' && out.text ()[2001] == '>' && out.text ()[2002] == '7');
+    }
+    {
+        // same as printf "%g", also under a locale with a different decimal point
+        const char* saved = setlocale (LC_NUMERIC, NULL);
+        std::string savedLocale = saved ? saved : "C";
+        std::vector<double> values = {0.0, -0.0, 1.0, -1.5, 0.1, 123456.0, 1234567.0, 999999.5, 9999995.0, 0.0001,
+            0.00001, 0.000123456789, 1e100, 1.7976931348623157e308, 5e-324, 2.2250738585072014e-308, 3.14159265,
+            HUGE_VAL, -HUGE_VAL, 100.0, 1e15, 123.456e-10,
+            // rounding of the 6th significant digit, ties
+            667.2075, 4.089125, 1234565.0, 100000.5, 1234.125};
+        // exact powers of ten, so m / 10^k and m * 10^k are the doubles closest to the decimal values
+        static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+            1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        unsigned x = 4711;
+        for (int n = 0; n < 10000; n++)
+        {
+            uint64_t bits = 0;
+            for (int k = 0; k < 4; k++)
+            {
+                x = x * 1103515245 + 12345;
+                bits = bits << 16 | (x >> 8 & 0xffff);
+            }
+            double d;
+            memcpy (&d, &bits, sizeof (d));
+            if (!std::isnan (d))
+                values.push_back (d);
+            values.push_back ((double)(x % 100000) / 1000);
+            // 7 significant digits, the 6th one is rounded
+            double digits7 = (double)(x % 9000000 + 1000000);
+            values.push_back (digits7 / pow10[x % 23]);
+            values.push_back (digits7 * pow10[x % 23]);
+            // ties: exactly halfway between two 6 digit values, rounded to even
+            values.push_back ((double)(x % 900000 + 100000) + 0.5);
+            values.push_back ((double)(x % 9000000 + 1000000) / 8);
+        }
+        for (double d : values)
+        {
+            char expected[64];
+            snprintf (expected, sizeof (expected), "%g", d);
+            setlocale (LC_NUMERIC, "de_DE.UTF-8");
+            cFormatBuffer out;
+            out.appendDouble (d);
+            setlocale (LC_NUMERIC, savedLocale.c_str ());
+            BUG_IF_NOT (out.length () == strlen (expected) && !memcmp (out.text (), expected, out.length ()));
+        }
+    }
+    {
+        // printed as a whole
+        CONSOLE_FORMAT (Debug, "{} {}\n", "formatted", 1);
+        CONSOLE_FORMAT (Debug, "no arguments {{}}\n");
+    }
+}
+#endif
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CONSOLEFORMAT_HPP_
+#define CONSOLEFORMAT_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "console.hpp"
+
+// Type-safe console output: every "{}" in the format is replaced by the next argument, "{{" and "}}" are literal
+// braces. The format must be a string literal; its placeholders are counted at compile time and must match the
+// arguments. Like the CONSOLE_* macros of console.hpp, the arguments are only evaluated if the level is enabled.
+//
+//     CONSOLE_FORMAT (Verbose, "{} of {} files, {} MB/s\n", done, files.size (), rate);
+//
+// Arguments are formatted without locale: integers in decimal, floating point like "%g", bool as true/false, char
+// as character, strings (const char* and std::string) as they are and other pointers in hex.
+#define CONSOLE_FORMAT(lvl, ...) \
+    do { if (Console::ShouldPrint (Console::lvl)) consoleFormat::print<consoleFormat::placeholders ( \
+        CONSOLE_FORMAT_STRING_ (__VA_ARGS__, 0))> (Console::lvl, __VA_ARGS__); } while (0)
+#define CONSOLE_FORMAT_STRING_(format, ...) format
+
+
+// Growable output buffer, starts on the stack
+class cFormatBuffer
+{
+public:
+    cFormatBuffer ()
+    {
+        data   = stack;
+        size   = sizeof (stack);
+        used   = 0;
+        failed = false;
+    }
+    ~cFormatBuffer ()
+    {
+        if (data != stack)
+            delete[] data;
+    }
+    cFormatBuffer (const cFormatBuffer&) = delete;
+    cFormatBuffer& operator= (const cFormatBuffer&) = delete;
+
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    void append (const char* text, size_t len)
+    {
+        if (used + len > size && !grow (len))
+            return;
+        memcpy (data + used, text, len);
+        used += len;
+    }
+    void append (char c)
+    {
+        if (used == size && !grow (1))
+            return;
+        data[used++] = c;
+    }
+    void appendSigned (int64_t value);
+    void appendUnsigned (uint64_t value);
+    void appendHex (uint64_t value);
+    // like printf "%g"
+    void appendDouble (double value);
+
+    const char* text () const
+    {
+        return data;
+    }
+    size_t length () const
+    {
+        return used;
+    }
+    void clear ()
+    {
+        used = 0;
+    }
+    // true if memory ran out; the text is incomplete
+    bool error () const
+    {
+        return failed;
+    }
+
+private:
+    char   stack[512];
+    char*  data;
+    size_t size;
+    size_t used;
+    bool   failed;
+
+    bool grow (size_t len);
+};
+
+
+namespace consoleFormat
+{
+    // number of placeholders "{}" in 'format', -1 for unmatched braces
+#if __cplusplus >= 201402L
+    constexpr int placeholders (const char* format)
+    {
+        int count = 0;
+        for (const char* f = format; *f; f++)
+        {
+            if ((*f == '{' && f[1] == '{') || (*f == '}' && f[1] == '}'))
+                f++;
+            else if (*f == '{' && f[1] == '}')
+                f++, count++;
+            else if (*f == '{' || *f == '}')
+                return -1;
+        }
+        return count;
+    }
+#else
+    // C++11 constexpr functions can't loop; the recursion limits the format to about 500 characters
+    constexpr int placeholders (const char* f, int count = 0)
+    {
+        return !*f ? count
+            : *f == '{' ? (f[1] == '{' ? placeholders (f + 2, count) : f[1] == '}' ? placeholders (f + 2, count + 1) : -1)
+            : *f == '}' ? (f[1] == '}' ? placeholders (f + 2, count) : -1)
+            : placeholders (f + 1, count);
+    }
+#endif
+
+    // copies 'format' up to the next placeholder, which is skipped
+    const char* appendLiteral (cFormatBuffer& out, const char* format);
+
+    inline void appendArg (cFormatBuffer& out, bool value)
+    {
+        if (value)
+            out.append ("true", 4);
+        else
+            out.append ("false", 5);
+    }
+    inline void appendArg (cFormatBuffer& out, char value)
+    {
+        out.append (value);
+    }
+    inline void appendArg (cFormatBuffer& out, const char* value)
+    {
+        if (value)
+            out.append (value, strlen (value));
+        else
+            out.append ("(null)", 6);
+    }
+    inline void appendArg (cFormatBuffer& out, const std::string& value)
+    {
+        out.append (value.data (), value.size ());
+    }
+    inline void appendArg (cFormatBuffer& out, double value)
+    {
+        out.appendDouble (value);
+    }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    appendArg (cFormatBuffer& out, T value)
+    {
+        out.appendSigned (value);
+    }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+    appendArg (cFormatBuffer& out, T value)
+    {
+        out.appendUnsigned (value);
+    }
+    template <typename T>
+    void appendArg (cFormatBuffer& out, const T* value)
+    {
+        out.append ("0x", 2);
+        out.appendHex ((uintptr_t)value);
+    }
+
+    inline void formatTo (cFormatBuffer& out, const char* format)
+    {
+        appendLiteral (out, format);
+    }
+    template <typename First, typename... Rest>
+    void formatTo (cFormatBuffer& out, const char* format, const First& first, const Rest&... rest)
+    {
+        format = appendLiteral (out, format);
+        appendArg (out, first);
+        formatTo (out, format, rest...);
+    }
+
+    // use CONSOLE_FORMAT, it provides N
+    template <int N, typename... Args>
+    int print (Console::out_level lvl, const char* format, const Args&... args)
+    {
+        static_assert (N >= 0, "unmatched brace in format string, literal braces are written {{ and }}");
+        static_assert (N == sizeof... (Args), "number of arguments doesn't match the {} in the format string");
+        cFormatBuffer out;
+        formatTo (out, format, args...);
+        return !out.error () && Console::Write (lvl, out.text (), out.length ());
+    }
+}
+
+#endif /* CONSOLEFORMAT_HPP_ */
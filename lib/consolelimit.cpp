@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#ifdef WITH_UNITTESTS
+#include <string>
+#include <thread>
+#endif
+
+#include "consolelimit.hpp"
+#include "bug.hpp"
+#ifdef WITH_UNITTESTS
+#include "consolesink.hpp"
+#endif
+
+
+// statements that suppressed messages
+static std::atomic<cConsoleLimit*> limited (nullptr);
+static std::atomic<bool> atExitRegistered (false);
+
+// milliseconds, > 0; a coarse clock is good enough and much cheaper where available
+static uint64_t now ()
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000 + 1;
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>
+        (std::chrono::steady_clock::now ().time_since_epoch ()).count () + 1;
+#endif
+}
+
+static void printSuppressedAtExit ()
+{
+    cConsoleLimit::printSuppressed ();
+}
+
+
+bool cConsoleLimit::rate (Console::out_level lvl, unsigned perSecond, const char* format)
+{
+    const uint64_t MASK = ((uint64_t)1 << TOKEN_BITS) - 1;
+    uint64_t max = perSecond < MASK ? perSecond : MASK;
+    uint64_t time = now ();
+    uint64_t old = state.load (std::memory_order_relaxed);
+    for (;;)
+    {
+        uint64_t last = old >> TOKEN_BITS;
+        uint64_t tokens = old & MASK;
+        if (!old || time - last >= 1000)
+        {
+            last   = time;
+            tokens = max;
+        }
+        else if (time > last)
+        {
+            // one token per 1000 / max milliseconds, the remainder is kept for the next refill
+            uint64_t refill = (time - last) * max / 1000;
+            if (refill)
+            {
+                tokens = tokens + refill < max ? tokens + refill : max;
+                last   = tokens == max ? time : last + refill * 1000 / max;
+            }
+        }
+        if (!tokens)
+            return suppress (lvl, format);
+        if (state.compare_exchange_weak (old, last << TOKEN_BITS | (tokens - 1), std::memory_order_relaxed))
+            return pass (lvl, format);
+    }
+}
+
+bool cConsoleLimit::sample (Console::out_level lvl, unsigned every, const char* format)
+{
+    if (every <= 1 || calls.fetch_add (1, std::memory_order_relaxed) % every == 0)
+        return pass (lvl, format);
+    return suppress (lvl, format);
+}
+
+bool cConsoleLimit::pass (Console::out_level lvl, const char* format)
+{
+    if (suppressed.load (std::memory_order_relaxed))
+    {
+        uint64_t count = suppressed.exchange (0);
+        if (count)
+            printSummary (lvl, count, format);
+    }
+    return true;
+}
+
+bool cConsoleLimit::suppress (Console::out_level lvl, const char* format)
+{
+    suppressed.fetch_add (1, std::memory_order_relaxed);
+    if (!listed.load (std::memory_order_relaxed) && !listed.exchange (true))
+    {
+        level = lvl;
+        this->format = format;
+        next = limited.load ();
+        while (!limited.compare_exchange_weak (next, this))
+        {
+        }
+        if (!atExitRegistered.exchange (true))
+            std::atexit (printSuppressedAtExit);
+    }
+    return false;
+}
+
+void cConsoleLimit::printSuppressed ()
+{
+    for (cConsoleLimit* limit = limited.load (); limit; limit = limit->next)
+    {
+        uint64_t count = limit->suppressed.exchange (0);
+        if (count)
+            printSummary (limit->level, count, limit->format);
+    }
+}
+
+void cConsoleLimit::printSummary (int level, uint64_t count, const char* format)
+{
+    Console::PrintAt ((Console::out_level)level, "suppressed %llu messages like: %.*s\n", (unsigned long long)count,
+        (int)strcspn (format, "\n"), format);
+}
+
+
+#ifdef WITH_UNITTESTS
+void cConsoleLimit::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+    cMemorySink memory;
+    char out[64 * 1024];
+    BUG_IF_NOT (memory.init (sizeof (out)));
+    Console::SetSink (&memory);
+
+    // the messages use level Normal, which is compiled in even with CONSOLE_MIN_LEVEL 3
+    auto lines = [&](const char* text)
+    {
+        size_t len = memory.read (out, sizeof (out));
+        int count = 0;
+        for (const char* p = out; p < out + len; p = (const char*)memchr (p, '\n', (size_t)(out + len - p)) + 1)
+        {
+            if (!strncmp (p, text, strlen (text)))
+                count++;
+        }
+        return count;
+    };
+
+    // a burst of 1000 gets 5 through, the rest is reported in one summary
+    for (int n = 0; n < 1000; n++)
+        CONSOLE_LIMITED (Normal, 5, "limited %d\nsecond line\n", n);
+    BUG_IF_NOT (lines ("limited ") == 5);
+    printSuppressed ();
+    BUG_IF_NOT (lines ("suppressed 995 messages like: limited %d\n") == 1);
+    printSuppressed ();
+    BUG_IF_NOT (lines ("suppressed ") == 1);
+
+    // tokens come back over time: 10 at once, then one per 100 ms
+    for (int n = 0; n < 15; n++)
+    {
+        CONSOLE_LIMITED (Normal, 10, "refilled %d\n", n);
+        if (n == 11)
+            std::this_thread::sleep_for (std::chrono::milliseconds (250));
+    }
+    BUG_IF_NOT (lines ("refilled ") >= 11 && lines ("refilled ") <= 13);
+    BUG_IF_NOT (lines ("suppressed 2 messages like: refilled %d\n") == 1);
+
+    // 1 of 10, the suppressed ones are reported before the next one
+    for (int n = 0; n < 100; n++)
+        CONSOLE_SAMPLED (Normal, 10, "sampled %d\n", n);
+    BUG_IF_NOT (lines ("sampled ") == 10);
+    BUG_IF_NOT (lines ("suppressed 9 messages like: sampled %d") == 9);
+
+    // disabled levels are not counted
+    Console::SetPrintLevel (Console::Normal);
+    for (int n = 0; n < 100; n++)
+        CONSOLE_SAMPLED (Verbose, 10, "disabled %d\n", n);
+    Console::SetPrintLevel (Console::Debug);
+    printSuppressed ();
+    BUG_IF_NOT (lines ("disabled ") == 0 && lines ("suppressed 9 messages like: disabled") == 0);
+
+    Console::SetSink (nullptr);
+}
+#endif
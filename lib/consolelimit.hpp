@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CONSOLELIMIT_HPP_
+#define CONSOLELIMIT_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+#include "console.hpp"
+
+// At most 'perSecond' messages per second from this statement, with bursts up to 'perSecond'.
+//
+//     CONSOLE_LIMITED (Verbose, 10, "worker %d stalled\n", id);
+//
+// The number of suppressed messages is printed before the next message that gets through and, for statements that
+// stay quiet, by cConsoleLimit::printSuppressed, which runs at exit.
+#define CONSOLE_LIMITED(lvl, perSecond, ...) \
+    do { if (Console::ShouldPrint (Console::lvl)) { static cConsoleLimit consoleLimit_; \
+        if (consoleLimit_.rate (Console::lvl, perSecond, CONSOLE_LIMIT_FORMAT_ (__VA_ARGS__, 0))) \
+            Console::PrintAt (Console::lvl, __VA_ARGS__); } } while (0)
+
+// Only every 'every'th message from this statement (the first, the every+1st, ...), otherwise like CONSOLE_LIMITED.
+#define CONSOLE_SAMPLED(lvl, every, ...) \
+    do { if (Console::ShouldPrint (Console::lvl)) { static cConsoleLimit consoleLimit_; \
+        if (consoleLimit_.sample (Console::lvl, every, CONSOLE_LIMIT_FORMAT_ (__VA_ARGS__, 0))) \
+            Console::PrintAt (Console::lvl, __VA_ARGS__); } } while (0)
+#define CONSOLE_LIMIT_FORMAT_(format, ...) format
+
+// state of one CONSOLE_LIMITED or CONSOLE_SAMPLED statement
+class cConsoleLimit
+{
+public:
+    constexpr cConsoleLimit () : state (0), calls (0), suppressed (0), listed (false), next (nullptr), level (0),
+        format (nullptr)
+    {
+    }
+
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    // true if the message may be printed; if not, it's counted
+    bool rate (Console::out_level lvl, unsigned perSecond, const char* format);
+    bool sample (Console::out_level lvl, unsigned every, const char* format);
+
+    // prints the numbers of messages suppressed since the last message of each statement
+    static void printSuppressed ();
+
+private:
+    // token bucket: milliseconds of the last refill << TOKEN_BITS | tokens
+    static const unsigned TOKEN_BITS = 24;
+    std::atomic<uint64_t> state;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> suppressed;
+
+    // statements that suppressed messages, for printSuppressed
+    std::atomic<bool> listed;
+    cConsoleLimit*    next;
+    int               level;
+    const char*       format;
+
+    bool pass (Console::out_level lvl, const char* format);
+    bool suppress (Console::out_level lvl, const char* format);
+    static void printSummary (int level, uint64_t count, const char* format);
+};
+
+#endif /* CONSOLELIMIT_HPP_ */
@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#include <new>
+#ifdef WITH_UNITTESTS
+#include <string>
+#include <thread>
+#include <vector>
+#endif
+
+#include "consolering.hpp"
+#include "bug.hpp"
+#include "console.hpp"
+
+
+cConsoleRing::cConsoleRing ()
+{
+    slots = NULL;
+    count = 0;
+    mask  = 0;
+    head  = 0;
+    tail  = 0;
+}
+
+cConsoleRing::~cConsoleRing ()
+{
+    delete[] slots;
+}
+
+bool cConsoleRing::init (size_t bytes)
+{
+    // power of two, at least a few slots
+    size_t n = 4;
+    while (n * SLOT_SIZE < bytes)
+        n *= 2;
+
+    slot* s = new (std::nothrow) slot[n];
+    if (!s)
+        return false;
+    delete[] slots;
+    slots = s;
+    count = n;
+    mask  = n - 1;
+    for (size_t i = 0; i < n; i++)
+        slots[i].seq.store (i, std::memory_order_relaxed);
+    head.store (0, std::memory_order_relaxed);
+    tail.store (0, std::memory_order_release);
+    return true;
+}
+
+size_t cConsoleRing::maxRecord () const
+{
+    return count * SLOT_DATA - sizeof (recordLen);
+}
+
+bool cConsoleRing::push (const char* data, size_t len)
+{
+    if (!slots || len > maxRecord ())
+        return false;
+    size_t k = (sizeof (recordLen) + len + SLOT_DATA - 1) / SLOT_DATA;
+
+    // The consumer frees slots in order, so if the last slot of the range is free, all others are free as well.
+    size_t pos = head.load (std::memory_order_relaxed);
+    for (;;)
+    {
+        size_t last = pos + k - 1;
+        size_t seq = slots[last & mask].seq.load (std::memory_order_acquire);
+        if (seq == last)
+        {
+            if (head.compare_exchange_weak (pos, pos + k, std::memory_order_relaxed))
+                break;
+        }
+        else if ((ptrdiff_t)(seq - last) < 0)
+        {
+            return false; // full
+        }
+        else
+        {
+            pos = head.load (std::memory_order_relaxed);
+        }
+    }
+
+    // length and text, possibly wrapping around the end of the ring
+    recordLen l = (recordLen)len;
+    memcpy (slots[pos & mask].data, &l, sizeof (l));
+    size_t offset = sizeof (l);
+    for (size_t i = 0; i < k; i++)
+    {
+        char* dst = slots[(pos + i) & mask].data;
+        size_t chunk = SLOT_DATA - offset;
+        if (chunk > len)
+            chunk = len;
+        memcpy (dst + offset, data, chunk);
+        data += chunk;
+        len  -= chunk;
+        offset = 0;
+    }
+
+    // the consumer only looks at the first slot, it is published last
+    for (size_t i = k - 1; i > 0; i--)
+        slots[(pos + i) & mask].seq.store (pos + i + 1, std::memory_order_release);
+    slots[pos & mask].seq.store (pos + 1, std::memory_order_release);
+    return true;
+}
+
+size_t cConsoleRing::pop (char* out, size_t max)
+{
+    if (!slots)
+        return 0;
+
+    size_t pos = tail.load (std::memory_order_relaxed);
+    size_t n = 0;
+    for (;;)
+    {
+        slot& first = slots[pos & mask];
+        if (first.seq.load (std::memory_order_acquire) != pos + 1)
+            break;
+        recordLen len;
+        memcpy (&len, first.data, sizeof (len));
+        if (n + len > max)
+            break;
+        size_t k = (sizeof (recordLen) + len + SLOT_DATA - 1) / SLOT_DATA;
+
+        size_t offset = sizeof (len);
+        size_t left = len;
+        for (size_t i = 0; i < k; i++)
+        {
+            size_t chunk = SLOT_DATA - offset;
+            if (chunk > left)
+                chunk = left;
+            memcpy (out + n, slots[(pos + i) & mask].data + offset, chunk);
+            n    += chunk;
+            left -= chunk;
+            offset = 0;
+        }
+        // free the slots for the next round, in order
+        for (size_t i = 0; i < k; i++)
+            slots[(pos + i) & mask].seq.store (pos + i + count, std::memory_order_release);
+        pos += k;
+    }
+    tail.store (pos, std::memory_order_release);
+    return n;
+}
+
+bool cConsoleRing::empty () const
+{
+    return head.load (std::memory_order_acquire) == tail.load (std::memory_order_acquire);
+}
+
+
+#ifdef WITH_UNITTESTS
+void cConsoleRing::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+    {
+        cConsoleRing ring;
+        char out[4096];
+        BUG_IF_NOT (!ring.push ("x", 1) && ring.pop (out, sizeof (out)) == 0);
+        BUG_IF_NOT (ring.init (1024));
+        BUG_IF_NOT (ring.maxRecord () == 8 * SLOT_DATA - sizeof (recordLen));
+        BUG_IF_NOT (ring.empty ());
+
+        // records of all sizes, wrapping around many times
+        std::string expected;
+        std::string record;
+        for (size_t n = 0; n < 2000; n++)
+        {
+            record.assign (n % (ring.maxRecord () + 1), (char)('a' + n % 26));
+            if (!ring.push (record.data (), record.size ()))
+            {
+                size_t len = ring.pop (out, sizeof (out));
+                BUG_IF_NOT (len > 0 && len <= expected.size ());
+                BUG_IF_NOT (!memcmp (out, expected.data (), len));
+                expected.erase (0, len);
+                BUG_IF_NOT (ring.push (record.data (), record.size ()));
+            }
+            expected += record;
+            BUG_IF_NOT (!ring.empty () || record.empty ());
+        }
+        size_t len = ring.pop (out, sizeof (out));
+        BUG_IF_NOT (len == expected.size () && !memcmp (out, expected.data (), len));
+        BUG_IF_NOT (ring.empty ());
+
+        // too long
+        record.assign (ring.maxRecord () + 1, 'x');
+        BUG_IF_NOT (!ring.push (record.data (), record.size ()));
+        // a full ring rejects records until the consumer frees slots
+        BUG_IF_NOT (ring.push (record.data (), record.size () - 1));
+        BUG_IF_NOT (!ring.push ("x", 1));
+        BUG_IF_NOT (ring.pop (out, 10) == 0);
+        BUG_IF_NOT (ring.pop (out, sizeof (out)) == record.size () - 1);
+        BUG_IF_NOT (ring.push ("x", 1));
+    }
+    {
+        // several producers; the records of each producer must arrive complete and in order
+        const int PRODUCERS = 4;
+        const int RECORDS = 20000;
+        cConsoleRing ring;
+        BUG_IF_NOT (ring.init (4096));
+
+        std::vector<std::thread> producers;
+        for (int p = 0; p < PRODUCERS; p++)
+        {
+            producers.emplace_back ([&ring, p]()
+            {
+                char record[64];
+                for (int n = 0; n < RECORDS; n++)
+                {
+                    int len = snprintf (record, sizeof (record), "%d %d %.*s\n", p, n, n % 40, "........................................");
+                    while (!ring.push (record, (size_t)len))
+                        std::this_thread::yield ();
+                }
+            });
+        }
+
+        int next[PRODUCERS] = {0};
+        int received = 0;
+        std::vector<char> out (ring.maxRecord ());
+        std::string pending;
+        while (received < PRODUCERS * RECORDS)
+        {
+            size_t len = ring.pop (out.data (), out.size ());
+            if (!len)
+            {
+                std::this_thread::yield ();
+                continue;
+            }
+            pending.append (out.data (), len);
+            size_t eol;
+            while ((eol = pending.find ('\n')) != std::string::npos)
+            {
+                int p, n, dots;
+                char rest[64];
+                BUG_IF_NOT (sscanf (pending.c_str (), "%d %d %63[.]", &p, &n, rest) >= 2);
+                dots = (int)(eol - pending.find (' ', pending.find (' ') + 1) - 1);
+                BUG_IF_NOT (p >= 0 && p < PRODUCERS && n == next[p]);
+                BUG_IF_NOT (dots == n % 40);
+                next[p]++;
+                received++;
+                pending.erase (0, eol + 1);
+            }
+        }
+        for (auto& t : producers)
+            t.join ();
+        BUG_IF_NOT (pending.empty () && ring.empty ());
+    }
+}
+#endif
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CONSOLERING_HPP_
+#define CONSOLERING_HPP_
+
+// internal header of the asynchronous console
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue of text records with many producers and one consumer. Records are stored in fixed-size
+// slots; a record occupies as many consecutive slots as it needs. Every slot has a sequence number telling whether
+// it is free for the producers of a round or holds data for the consumer (like Dmitry Vyukov's bounded queue).
+class cConsoleRing
+{
+public:
+    cConsoleRing ();
+    ~cConsoleRing ();
+    cConsoleRing (const cConsoleRing&) = delete;
+    cConsoleRing& operator= (const cConsoleRing&) = delete;
+
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    // allocates about 'bytes' of slots; must not be called while the ring is in use
+    bool init (size_t bytes);
+    // longest record that fits
+    size_t maxRecord () const;
+
+    // copies a record into the ring; false if there is not enough free space. Never blocks.
+    bool push (const char* data, size_t len);
+    // Consumer only: copies complete records to 'out' and frees their slots. Stops before a record that doesn't fit
+    // into 'max' bytes ('max' >= maxRecord () always takes at least one). Returns the number of bytes copied.
+    size_t pop (char* out, size_t max);
+    // all records pushed so far are popped
+    bool empty () const;
+    // position behind the records pushed so far, and whether the consumer has popped everything in front of it
+    size_t mark () const
+    {
+        return head.load (std::memory_order_acquire);
+    }
+    bool reached (size_t mark) const
+    {
+        return (ptrdiff_t)(tail.load (std::memory_order_acquire) - mark) >= 0;
+    }
+
+private:
+    static const size_t SLOT_SIZE = 128;
+    struct slot
+    {
+        std::atomic<size_t> seq;
+        char                data[SLOT_SIZE - sizeof (std::atomic<size_t>)];
+    };
+    static const size_t SLOT_DATA = sizeof (((slot*)0)->data);
+    // the length of a record is stored in front of its text
+    typedef unsigned int recordLen;
+
+    slot*  slots;
+    size_t count;
+    size_t mask;
+    // producers and consumer on different cache lines
+    alignas (64) std::atomic<size_t> head;
+    alignas (64) std::atomic<size_t> tail;
+};
+
+#endif /* CONSOLERING_HPP_ */
@@ -0,0 +1,520 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#ifdef HAVE_WINDOWS
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#ifdef WITH_UNITTESTS
+#include <thread>
+#include <vector>
+#endif
+
+#include "consolesink.hpp"
+#include "bug.hpp"
+#include "console.hpp"
+
+
+// writes all segments, continues after partial writes
+static bool writeSegments (int fd, const char* a, size_t alen, const char* b, size_t blen)
+{
+#ifdef HAVE_WINDOWS
+    const char* seg[2] = {a, b};
+    size_t len[2] = {alen, blen};
+    for (int n = 0; n < 2; n++)
+    {
+        while (len[n])
+        {
+            int w = _write (fd, seg[n], (unsigned)len[n]);
+            if (w < 0)
+                return false;
+            seg[n] += w;
+            len[n] -= (size_t)w;
+        }
+    }
+    return true;
+#else
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(a);
+    iov[0].iov_len  = alen;
+    iov[1].iov_base = const_cast<char*>(b);
+    iov[1].iov_len  = blen;
+    struct iovec* v = iov;
+    int n = 2;
+    while (n > 0 && !v->iov_len)
+    {
+        v++;
+        n--;
+    }
+    while (n > 0)
+    {
+        ssize_t w = writev (fd, v, n);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        while (n > 0 && (size_t)w >= v->iov_len)
+        {
+            w -= (ssize_t)v->iov_len;
+            v++;
+            n--;
+        }
+        if (n > 0)
+        {
+            v->iov_base = static_cast<char*>(v->iov_base) + w;
+            v->iov_len -= (size_t)w;
+        }
+    }
+    return true;
+#endif
+}
+
+
+bool cStderrSink::write (const char* text, size_t len)
+{
+#ifdef HAVE_WINDOWS
+    bool ret = fwrite (text, 1, len, stderr) == len;
+    fflush (stderr);
+    return ret;
+#else
+    // not through stdio: its lock would serialize all threads and large messages could be split
+    return writeSegments (2, text, len, NULL, 0);
+#endif
+}
+
+
+cFdSink::cFdSink (size_t bufferSize, unsigned maxDelayMs)
+: maxDelay (maxDelayMs)
+{
+    this->fd         = -1;
+    this->ownFd      = false;
+    this->buffer     = NULL;
+    this->bufferSize = bufferSize;
+    this->used       = 0;
+}
+
+cFdSink::~cFdSink ()
+{
+    close ();
+    delete[] buffer;
+}
+
+bool cFdSink::allocate ()
+{
+    if (!buffer && bufferSize)
+        buffer = new (std::nothrow) char[bufferSize];
+    return buffer || !bufferSize;
+}
+
+bool cFdSink::open (const char* path)
+{
+    close ();
+    if (!allocate ())
+        return false;
+#ifdef HAVE_WINDOWS
+    fd = _open (path, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, 0644);
+#else
+    fd = ::open (path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+    ownFd = fd >= 0;
+    return fd >= 0;
+}
+
+bool cFdSink::attach (int fd)
+{
+    close ();
+    if (!allocate ())
+        return false;
+    this->fd = fd;
+    return fd >= 0;
+}
+
+void cFdSink::close ()
+{
+    flush ();
+    if (ownFd)
+#ifdef HAVE_WINDOWS
+        _close (fd);
+#else
+        ::close (fd);
+#endif
+    fd    = -1;
+    ownFd = false;
+}
+
+bool cFdSink::write (const char* text, size_t len)
+{
+    if (fd < 0)
+        return false;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now ();
+    if (used + len > bufferSize)
+        return writeBuffer (text, len);
+
+    if (!used)
+        firstBuffered = now;
+    memcpy (buffer + used, text, len);
+    used += len;
+    if (now - firstBuffered >= maxDelay)
+        return flush ();
+    return true;
+}
+
+bool cFdSink::flush ()
+{
+    return writeBuffer (NULL, 0);
+}
+
+bool cFdSink::writeBuffer (const char* text, size_t len)
+{
+    if (fd < 0 || (!used && !len))
+        return fd >= 0;
+    bool ret = writeSegments (fd, buffer, used, text, len);
+    used = 0;
+    return ret;
+}
+
+
+cRotatingFileSink::cRotatingFileSink (size_t maxFileSize, unsigned keep, size_t bufferSize, unsigned maxDelayMs)
+: cFdSink (bufferSize, maxDelayMs)
+{
+    this->maxFileSize = maxFileSize;
+    this->keep        = keep;
+    this->fileSize    = 0;
+}
+
+bool cRotatingFileSink::open (const char* path)
+{
+    try
+    {
+        this->path = path;
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
+    }
+    if (!cFdSink::open (path))
+        return false;
+
+#ifdef HAVE_WINDOWS
+    long size = _lseek (fd, 0, SEEK_END);
+#else
+    off_t size = lseek (fd, 0, SEEK_END);
+#endif
+    fileSize = size > 0 ? (size_t)size : 0;
+    return true;
+}
+
+bool cRotatingFileSink::write (const char* text, size_t len)
+{
+    // a single message larger than a file gets a file on its own
+    if (fileSize && fileSize + len > maxFileSize && !rotate ())
+        return false;
+    fileSize += len;
+    return cFdSink::write (text, len);
+}
+
+bool cRotatingFileSink::rotate ()
+{
+    close ();
+
+    // path.keep-1 -> path.keep, ..., path -> path.1
+    std::string from, to;
+    try
+    {
+        for (unsigned n = keep; n > 0; n--)
+        {
+            from = n > 1 ? path + "." + std::to_string (n - 1) : path;
+            to   = path + "." + std::to_string (n);
+            std::rename (from.c_str (), to.c_str ());
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
+    }
+    if (!keep)
+        std::remove (path.c_str ());
+
+    fileSize = 0;
+    return cFdSink::open (path.c_str ());
+}
+
+
+cMemorySink::cMemorySink ()
+{
+    data     = NULL;
+    capacity = 0;
+    pos      = 0;
+    filled   = 0;
+}
+
+cMemorySink::~cMemorySink ()
+{
+    delete[] data;
+}
+
+bool cMemorySink::init (size_t capacity)
+{
+    char* p = new (std::nothrow) char[capacity ? capacity : 1];
+    if (!p)
+        return false;
+    delete[] data;
+    data = p;
+    this->capacity = capacity;
+    pos    = 0;
+    filled = 0;
+    return true;
+}
+
+bool cMemorySink::write (const char* text, size_t len)
+{
+    if (!capacity)
+        return false;
+    // only the tail of a message larger than the whole buffer survives anyway
+    if (len > capacity)
+    {
+        text += len - capacity;
+        len   = capacity;
+    }
+    size_t first = capacity - pos < len ? capacity - pos : len;
+    memcpy (data + pos, text, first);
+    memcpy (data, text + first, len - first);
+    pos = (pos + len) % capacity;
+    filled = filled + len < capacity ? filled + len : capacity;
+    return true;
+}
+
+size_t cMemorySink::read (char* out, size_t max) const
+{
+    size_t len = filled < max ? filled : max;
+    // the newest 'len' bytes end at 'pos'
+    size_t start = (pos + capacity - len) % (capacity ? capacity : 1);
+    size_t first = capacity - start < len ? capacity - start : len;
+    memcpy (out, data + start, first);
+    memcpy (out + first, data, len - first);
+    return len;
+}
+
+bool cMemorySink::dump (int fd) const
+{
+    size_t start = (pos + capacity - filled) % (capacity ? capacity : 1);
+    size_t first = capacity - start < filled ? capacity - start : filled;
+    return writeSegments (fd, data + start, first, data, filled - first);
+}
+
+
+cDatagramSink::cDatagramSink ()
+{
+    fd = -1;
+}
+
+cDatagramSink::~cDatagramSink ()
+{
+    close ();
+}
+
+bool cDatagramSink::open (const char* socketPath)
+{
+    close ();
+#ifdef HAVE_WINDOWS
+    (void)socketPath;
+    return false;
+#else
+    struct sockaddr_un addr;
+    if (strlen (socketPath) >= sizeof (addr.sun_path))
+        return false;
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, socketPath);
+
+    fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    if (connect (fd, (struct sockaddr*)&addr, sizeof (addr)))
+    {
+        close ();
+        return false;
+    }
+    return true;
+#endif
+}
+
+void cDatagramSink::close ()
+{
+#ifndef HAVE_WINDOWS
+    if (fd >= 0)
+        ::close (fd);
+#endif
+    fd = -1;
+}
+
+bool cDatagramSink::write (const char* text, size_t len)
+{
+#ifdef HAVE_WINDOWS
+    (void)text;
+    (void)len;
+    return false;
+#else
+    if (fd < 0)
+        return false;
+    ssize_t ret;
+    do
+    {
+        ret = send (fd, text, len, MSG_DONTWAIT);
+    } while (ret < 0 && errno == EINTR);
+    return ret == (ssize_t)len;
+#endif
+}
+
+
+#ifdef WITH_UNITTESTS
+void cFdSink::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+#ifndef HAVE_WINDOWS
+    {
+        // buffered until full, then buffer and message in one go
+        int fds[2];
+        BUG_IF_NOT (!pipe (fds));
+        char in[256];
+        {
+            cFdSink sink (16, 60000);
+            BUG_IF_NOT (!sink.write ("x", 1));
+            BUG_IF_NOT (sink.attach (fds[1]));
+            BUG_IF_NOT (sink.write ("0123456789", 10));
+            BUG_IF_NOT (sink.write ("abcde", 5));
+            BUG_IF_NOT (fcntl (fds[0], F_SETFL, O_NONBLOCK) == 0 && ::read (fds[0], in, sizeof (in)) < 0);
+            BUG_IF_NOT (sink.write ("ABCDEFGHIJKLMNOPQRSTUVWXYZ", 26));
+            BUG_IF_NOT (::read (fds[0], in, sizeof (in)) == 41 && !memcmp (in, "0123456789abcdeABCDEFGHIJKLMNOPQRSTUVWXYZ", 41));
+            BUG_IF_NOT (sink.write ("!", 1));
+            BUG_IF_NOT (sink.flush ());
+            BUG_IF_NOT (::read (fds[0], in, sizeof (in)) == 1 && in[0] == '!');
+            BUG_IF_NOT (sink.write ("?", 1));
+        }
+        // flushed by the destructor; the fd was attached, so it is still open
+        BUG_IF_NOT (::read (fds[0], in, sizeof (in)) == 1 && in[0] == '?');
+        BUG_IF_NOT (!::close (fds[1]));
+        ::close (fds[0]);
+    }
+    {
+        // time based flush
+        int fds[2];
+        BUG_IF_NOT (!pipe (fds));
+        char in[16];
+        cFdSink sink (1024, 1);
+        BUG_IF_NOT (sink.attach (fds[1]));
+        BUG_IF_NOT (sink.write ("a", 1));
+        std::this_thread::sleep_for (std::chrono::milliseconds (5));
+        BUG_IF_NOT (sink.write ("b", 1));
+        BUG_IF_NOT (::read (fds[0], in, sizeof (in)) == 2 && !memcmp (in, "ab", 2));
+        sink.close ();
+        ::close (fds[0]);
+        ::close (fds[1]);
+    }
+    {
+        // rotation
+        char dir[] = "/tmp/cmdline-unittest-XXXXXX";
+        BUG_IF_NOT (mkdtemp (dir));
+        std::string path = std::string (dir) + "/log";
+        {
+            cRotatingFileSink sink (10, 2, 4);
+            BUG_IF_NOT (sink.open (path.c_str ()));
+            const char* lines[] = {"1111\n", "2222\n", "3333\n", "4444\n", "5555\n", "66666666666666\n", "7777\n"};
+            for (const char* line : lines)
+                BUG_IF_NOT (sink.write (line, strlen (line)));
+        }
+        struct stat st;
+        BUG_IF_NOT (!stat (path.c_str (), &st) && st.st_size == 5);
+        BUG_IF_NOT (!stat ((path + ".1").c_str (), &st) && st.st_size == 15);
+        BUG_IF_NOT (!stat ((path + ".2").c_str (), &st) && st.st_size == 5);
+        BUG_IF_NOT (stat ((path + ".3").c_str (), &st));
+        FILE* f = fopen (path.c_str (), "r");
+        char line[16];
+        BUG_IF_NOT (f && fgets (line, sizeof (line), f) && !strcmp (line, "7777\n"));
+        fclose (f);
+        f = fopen ((path + ".2").c_str (), "r");
+        BUG_IF_NOT (f && fgets (line, sizeof (line), f) && !strcmp (line, "5555\n"));
+        fclose (f);
+        remove (path.c_str ());
+        remove ((path + ".1").c_str ());
+        remove ((path + ".2").c_str ());
+        rmdir (dir);
+    }
+    {
+        // datagrams
+        char dir[] = "/tmp/cmdline-unittest-XXXXXX";
+        BUG_IF_NOT (mkdtemp (dir));
+        std::string path = std::string (dir) + "/sock";
+        int rx = socket (AF_UNIX, SOCK_DGRAM, 0);
+        struct sockaddr_un addr;
+        memset (&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        strcpy (addr.sun_path, path.c_str ());
+        BUG_IF_NOT (rx >= 0 && !bind (rx, (struct sockaddr*)&addr, sizeof (addr)));
+
+        cDatagramSink sink;
+        BUG_IF_NOT (!sink.write ("x", 1));
+        BUG_IF_NOT (!sink.open ((path + "x").c_str ()));
+        BUG_IF_NOT (sink.open (path.c_str ()));
+        BUG_IF_NOT (sink.write ("hello\n", 6) && sink.write ("world\n", 6));
+        char in[16];
+        BUG_IF_NOT (recv (rx, in, sizeof (in), 0) == 6 && !memcmp (in, "hello\n", 6));
+        BUG_IF_NOT (recv (rx, in, sizeof (in), 0) == 6 && !memcmp (in, "world\n", 6));
+        sink.close ();
+        ::close (rx);
+        unlink (path.c_str ());
+        rmdir (dir);
+    }
+#endif
+    {
+        cMemorySink sink;
+        char out[16];
+        BUG_IF_NOT (!sink.write ("x", 1));
+        BUG_IF_NOT (sink.init (8));
+        BUG_IF_NOT (sink.read (out, sizeof (out)) == 0);
+        BUG_IF_NOT (sink.write ("abc", 3) && sink.read (out, sizeof (out)) == 3 && !memcmp (out, "abc", 3));
+        BUG_IF_NOT (sink.write ("defghi", 6) && sink.read (out, sizeof (out)) == 8 && !memcmp (out, "bcdefghi", 8));
+        BUG_IF_NOT (sink.read (out, 2) == 2 && !memcmp (out, "hi", 2));
+        BUG_IF_NOT (sink.write ("0123456789AB", 12) && sink.read (out, sizeof (out)) == 8 && !memcmp (out, "456789AB", 8));
+#ifndef HAVE_WINDOWS
+        int fds[2];
+        BUG_IF_NOT (!pipe (fds));
+        BUG_IF_NOT (sink.write ("CD", 2) && sink.dump (fds[1]));
+        BUG_IF_NOT (::read (fds[0], out, sizeof (out)) == 8 && !memcmp (out, "6789ABCD", 8));
+        ::close (fds[0]);
+        ::close (fds[1]);
+#endif
+    }
+}
+#endif
@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CONSOLESINK_HPP_
+#define CONSOLESINK_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+// Destination of the console output, see Console::SetSink.
+class cConsoleSink
+{
+public:
+    virtual ~cConsoleSink ()
+    {
+    }
+    // one or more complete messages
+    virtual bool write (const char* text, size_t len) = 0;
+    // writes out anything buffered
+    virtual bool flush ()
+    {
+        return true;
+    }
+    // true if write may be called by several threads at once; otherwise the console serializes the calls
+    virtual bool concurrent () const
+    {
+        return false;
+    }
+};
+
+// the default: stderr, one write(2) per message, which is atomic for up to PIPE_BUF bytes on pipes
+class cStderrSink : public cConsoleSink
+{
+public:
+    bool write (const char* text, size_t len) override;
+    bool concurrent () const override
+    {
+        return true;
+    }
+};
+
+// File descriptor with a large buffer in user space. The buffer is written when it is full, when buffered output
+// is older than 'maxDelayMs' at the next write, on flush and on destruction. A message that doesn't fit any more
+// is written together with the buffer by one writev call.
+class cFdSink : public cConsoleSink
+{
+public:
+    explicit cFdSink (size_t bufferSize = 64 * 1024, unsigned maxDelayMs = 100);
+    ~cFdSink ();
+    cFdSink (const cFdSink&) = delete;
+    cFdSink& operator= (const cFdSink&) = delete;
+
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    // appends to the file 'path'
+    bool open (const char* path);
+    // writes to 'fd', which is not closed by the sink
+    bool attach (int fd);
+    void close ();
+
+    bool write (const char* text, size_t len) override;
+    bool flush () override;
+
+protected:
+    // buffer and 'text' in one system call
+    bool writeBuffer (const char* text, size_t len);
+
+    int    fd;
+    bool   ownFd;
+    char*  buffer;
+    size_t bufferSize;
+    size_t used;
+    std::chrono::milliseconds maxDelay;
+    std::chrono::steady_clock::time_point firstBuffered;
+
+private:
+    bool allocate ();
+};
+
+// File that is renamed to 'path'.1 when it would exceed 'maxFileSize'; older files become 'path'.2 and so on,
+// 'keep' of them are kept.
+class cRotatingFileSink : public cFdSink
+{
+public:
+    explicit cRotatingFileSink (size_t maxFileSize, unsigned keep = 3, size_t bufferSize = 64 * 1024,
+        unsigned maxDelayMs = 100);
+
+    bool open (const char* path);
+    bool write (const char* text, size_t len) override;
+
+private:
+    std::string path;
+    size_t      maxFileSize;
+    unsigned    keep;
+    size_t      fileSize;
+
+    bool rotate ();
+};
+
+// Keeps the last 'capacity' bytes of output in memory, e.g. to dump them after a crash.
+class cMemorySink : public cConsoleSink
+{
+public:
+    cMemorySink ();
+    ~cMemorySink ();
+    cMemorySink (const cMemorySink&) = delete;
+    cMemorySink& operator= (const cMemorySink&) = delete;
+
+    bool init (size_t capacity);
+    bool write (const char* text, size_t len) override;
+
+    // copies the kept output, oldest first, and returns its length
+    size_t read (char* out, size_t max) const;
+    // writes the kept output to 'fd'
+    bool dump (int fd) const;
+
+private:
+    char*  data;
+    size_t capacity;
+    size_t pos;
+    size_t filled;
+};
+
+// Local UNIX datagram socket, e.g. of a log collector. Every write is one datagram; if the receiver can't keep up,
+// output is dropped instead of blocking.
+class cDatagramSink : public cConsoleSink
+{
+public:
+    cDatagramSink ();
+    ~cDatagramSink ();
+    cDatagramSink (const cDatagramSink&) = delete;
+    cDatagramSink& operator= (const cDatagramSink&) = delete;
+
+    bool open (const char* socketPath);
+    void close ();
+    bool write (const char* text, size_t len) override;
+    // open and close must not be called while printing
+    bool concurrent () const override
+    {
+        return true;
+    }
+
+private:
+    int fd;
+};
+
+#endif /* CONSOLESINK_HPP_ */
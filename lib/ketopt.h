@@ -20,14 +20,15 @@ typedef struct {
 } ketopt_t;
 
 typedef struct {
-    char *name;
+    const char *name;
     int has_arg;
     int val;
 } ko_longopt_t;
 
-static ketopt_t KETOPT_INIT = { 1, 0, 0, -1, 1, 0, 0 };
+/* LIBCMDLINE: everything is const/inline to be usable from headers */
+static const ketopt_t KETOPT_INIT = { 1, 0, 0, -1, 1, 0, 0 };
 
-static void ketopt_permute(char *argv[], int j, int n) /* move argv[j] over n elements to the left */
+static inline void ketopt_permute(char *argv[], int j, int n) /* move argv[j] over n elements to the left */
 {
     int k;
     char *p = argv[j];
@@ -36,6 +37,35 @@ static void ketopt_permute(char *argv[], int j, int n) /* move argv[j] over n el
     argv[j - k] = p;
 }
 
+/**
+ * Find a long option by its (possibly abbreviated) name
+ *
+ * Reference implementation that scans all long options. An exact match wins,
+ * otherwise the name must be a unique prefix of exactly one option.
+ *
+ * @param ctx       unused
+ * @param longopts  long options
+ * @param name      option name; not necessarily NULL-terminated
+ * @param len       length of name
+ *
+ * @return index into longopts; -1 if not found; -2 if ambiguous
+ */
+static inline int ko_longopt_scan(const void *ctx, const ko_longopt_t *longopts, const char *name, int len)
+{
+    int k, n_exact = 0, n_partial = 0, i_exact = -1, i_partial = -1;
+    (void)ctx;
+    for (k = 0; longopts[k].name != 0; ++k)
+        if (strncmp(name, longopts[k].name, len) == 0) {
+            if (longopts[k].name[len] == 0) ++n_exact, i_exact = k;
+            else ++n_partial, i_partial = k;
+        }
+    if (n_exact > 1 || (n_exact == 0 && n_partial > 1)) return -2;
+    return n_exact == 1? i_exact : n_partial == 1? i_partial : -1;
+}
+
+/* signature of a long option matcher; must behave like ko_longopt_scan() */
+typedef int (*ko_lookup_t)(const void *ctx, const ko_longopt_t *longopts, const char *name, int len);
+
 /**
  * Parse command-line options and arguments
  *
@@ -45,18 +75,24 @@ static void ketopt_permute(char *argv[], int j, int n) /* move argv[j] over n el
  * are parsed. In this case, s->ind is the index of the first non-option
  * argument.
  *
+ * LIBCMDLINE: 'lookup' and 'ctx' were added to replace the linear long option
+ * scan by an indexed one.
+ *
  * @param s         status; shall be initialized to KETOPT_INIT on the first call
  * @param argc      length of argv[]
  * @param argv      list of command-line arguments; argv[0] is ignored
  * @param permute   non-zero to move options ahead of non-option arguments
  * @param ostr      option string
  * @param longopts  long options
+ * @param lookup    long option matcher; ko_longopt_scan() if NULL
+ * @param ctx       passed to lookup
  *
  * @return ASCII for a short option; ko_longopt_t::val for a long option; -1 if
  *         argv[] is fully processed; '?' for an unknown option or an ambiguous
  *         long option; ':' if an option argument is missing
  */
-static int ketopt(ketopt_t *s, int argc, char *argv[], int permute, const char *ostr, const ko_longopt_t *longopts)
+static inline int ketopt(ketopt_t *s, int argc, char *argv[], int permute, const char *ostr, const ko_longopt_t *longopts,
+                         ko_lookup_t lookup, const void *ctx)
 {
     int opt = -1, i0, j;
     if (permute) {
@@ -76,16 +112,12 @@ static int ketopt(ketopt_t *s, int argc, char *argv[], int permute, const char *
         }
         s->opt = 0, opt = '?', s->pos = -1;
         if (longopts) { /* parse long options */
-            int k, n_exact = 0, n_partial = 0;
-            const ko_longopt_t *o = 0, *o_exact = 0, *o_partial = 0;
+            int k;
+            const ko_longopt_t *o = 0;
             for (j = 2; argv[s->i][j] != '\0' && argv[s->i][j] != '='; ++j) {} /* find the end of the option name */
-            for (k = 0; longopts[k].name != 0; ++k)
-                if (strncmp(&argv[s->i][2], longopts[k].name, j - 2) == 0) {
-                    if (longopts[k].name[j - 2] == 0) ++n_exact, o_exact = &longopts[k];
-                    else ++n_partial, o_partial = &longopts[k];
-                }
-            if (n_exact > 1 || (n_exact == 0 && n_partial > 1)) return '?';
-            o = n_exact == 1? o_exact : n_partial == 1? o_partial : 0;
+            k = (lookup? lookup : ko_longopt_scan)(ctx, longopts, &argv[s->i][2], j - 2);
+            if (k == -2) return '?';
+            o = k >= 0? &longopts[k] : 0;
             if (o) {
                 s->opt = opt = o->val, s->longidx = (int)(o - longopts);
                 if (argv[s->i][j] == '=') s->arg = &argv[s->i][j + 1];
@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+
+#include "longoptindex.hpp"
+#include "bug.hpp"
+
+
+cLongOptIndex::cLongOptIndex (cArena* arena)
+: nodes (cArenaAllocator<node> (arena))
+{
+    clear ();
+}
+
+void cLongOptIndex::clear ()
+{
+    node root;
+    root.c           = '\0';
+    root.firstChild  = -1;
+    root.nextSibling = -1;
+    root.names       = 0;
+    root.exact       = 0;
+    root.value       = NOT_FOUND;
+
+    nodes.clear ();
+    nodes.push_back (root);
+}
+
+void cLongOptIndex::reserve (size_t names)
+{
+    // a rough guess, names of related options usually share their prefixes
+    nodes.reserve (names * 8 + 1);
+}
+
+int cLongOptIndex::child (int parent, char c) const
+{
+    int n;
+    for (n = nodes[parent].firstChild; n >= 0 && nodes[n].c != c; n = nodes[n].nextSibling)
+    {
+    }
+    return n;
+}
+
+void cLongOptIndex::add (const char* name, int value)
+{
+    BUG_ON (value < 0);
+
+    int n = 0;
+    for (;;)
+    {
+        node& curr = nodes[n];
+        curr.names++;
+        if (curr.names == 1)
+            curr.value = value;
+
+        if (*name == '\0')
+        {
+            // exact matches win over abbreviations of longer names
+            curr.exact++;
+            curr.value = value;
+            break;
+        }
+
+        int next = child (n, *name);
+        if (next < 0)
+        {
+            node leaf;
+            leaf.c           = *name;
+            leaf.firstChild  = -1;
+            leaf.nextSibling = nodes[n].firstChild;
+            leaf.names       = 0;
+            leaf.exact       = 0;
+            leaf.value       = NOT_FOUND;
+
+            next = (int)nodes.size ();
+            nodes.push_back (leaf); // invalidates 'curr'
+            nodes[n].firstChild = next;
+        }
+        n = next;
+        name++;
+    }
+}
+
+int cLongOptIndex::find (const char* name, size_t len) const
+{
+    int n = 0;
+    for (size_t pos = 0; pos < len; pos++)
+    {
+        n = child (n, name[pos]);
+        if (n < 0)
+            return NOT_FOUND;
+    }
+
+    const node& match = nodes[n];
+    if (match.exact > 1)
+        return AMBIGUOUS;
+    if (match.exact == 1 || match.names == 1)
+        return match.value;
+    return match.names ? AMBIGUOUS : NOT_FOUND;
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LONGOPTINDEX_HPP_
+#define LONGOPTINDEX_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "arena.hpp"
+
+// Prefix tree over long option names. Finds exact matches and unique abbreviations
+// in O(length of name), with the same results as a linear scan with strncmp.
+class cLongOptIndex
+{
+public:
+    enum {NOT_FOUND = -1, AMBIGUOUS = -2};
+
+    explicit cLongOptIndex (cArena* arena = nullptr);
+
+    void clear ();
+    void reserve (size_t names);
+    // 'value' is returned by find; must be >= 0
+    void add (const char* name, int value);
+    // 'name' does not need to be NULL-terminated
+    int find (const char* name, size_t len) const;
+
+private:
+    struct node
+    {
+        char c;
+        int  firstChild;
+        int  nextSibling;
+        int  names;      // number of names in this subtree
+        int  exact;      // number of names ending here
+        int  value;      // value of a name ending here or, if names == 1, of the only name below
+    };
+    std::vector<node, cArenaAllocator<node> > nodes;
+
+    int child (int parent, char c) const;
+};
+
+#endif /* LONGOPTINDEX_HPP_ */
@@ -0,0 +1,397 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#ifdef WITH_UNITTESTS
+#include <cstdlib>
+#include <string>
+#include <vector>
+#endif
+
+#include "numberlist.hpp"
+#include "bug.hpp"
+#include "console.hpp"
+
+#if (defined (__GNUC__) || defined (__clang__)) && (defined (__x86_64__) || defined (__i386__))
+#define NUMBERLIST_X86
+#include <immintrin.h>
+#endif
+
+
+// reference implementation, byte by byte
+static cmdline_error scanScalar (const char* s, size_t len, bool ranges, uint64_t* out, size_t& count)
+{
+    size_t n = 0;
+    uint64_t v = 0;
+    size_t digits = 0;
+    bool dash = false;
+    bool overflow = false;
+
+    for (size_t i = 0; i <= len; i++)
+    {
+        char c = i < len ? s[i] : ',';
+        if (c >= '0' && c <= '9')
+        {
+            unsigned d = (unsigned)(c - '0');
+            if (v > (UINT64_MAX - d) / 10)
+                overflow = true;
+            else
+                v = v * 10 + d;
+            digits++;
+        }
+        else if (digits && (c == ',' || (ranges && c == '-' && !dash)))
+        {
+            out[n++] = v;
+            if (ranges && c == ',' && !dash)
+                out[n++] = v;
+            dash = c == '-';
+            v = 0;
+            digits = 0;
+        }
+        else
+        {
+            return CMDLINE_INVALID_ARGUMENT;
+        }
+    }
+    count = n;
+    return overflow ? CMDLINE_OUT_OF_RANGE : CMDLINE_OK;
+}
+
+
+#ifdef NUMBERLIST_X86
+// 8 ASCII digits, the first one in the lowest byte (little endian)
+static inline uint64_t eightDigits (uint64_t x)
+{
+    x -= 0x3030303030303030ULL;
+    x = (x * 10) + (x >> 8);
+    return (((x & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+            (((x >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+}
+
+// up to 8 digits, padded with leading zeros
+static inline uint64_t shortDigits (const char* p, size_t n)
+{
+    uint64_t x = 0x3030303030303030ULL;
+    memcpy ((char*)&x + (8 - n), p, n);
+    return eightDigits (x);
+}
+
+// the 'n' <= 8 digits in front of 'end', where at least 8 bytes are readable
+static inline uint64_t digitsBefore (const char* end, size_t n)
+{
+    uint64_t x;
+    memcpy (&x, end - 8, 8);
+    // replace the bytes in front of the number by '0'
+    uint64_t pad = (~0ULL >> (8 * n - 1)) >> 1;
+    return eightDigits ((x & ~pad) | (0x3030303030303030ULL & pad));
+}
+
+// value of the 'n' > 0 digits at 'p'; returns false on overflow. 'readable' bytes in front of p + n can be read.
+static inline bool convertRun (const char* p, size_t n, size_t readable, uint64_t& value)
+{
+    const char* end = p + n;
+    if (n <= 8)
+    {
+        value = readable >= 8 ? digitsBefore (end, n) : shortDigits (p, n);
+    }
+    else if (n <= 16)
+    {
+        uint64_t low;
+        memcpy (&low, end - 8, 8);
+        value = (readable >= 16 ? digitsBefore (end - 8, n - 8) : shortDigits (p, n - 8)) * 100000000ULL + eightDigits (low);
+    }
+    else if (n <= 19)
+    {
+        // at most 19 digits always fit
+        uint64_t mid, low;
+        memcpy (&mid, end - 16, 8);
+        memcpy (&low, end - 8, 8);
+        value = (shortDigits (p, n - 16) * 100000000ULL + eightDigits (mid)) * 100000000ULL + eightDigits (low);
+    }
+    else
+    {
+        uint64_t v = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned d = (unsigned)(p[i] - '0');
+            if (v > (UINT64_MAX - d) / 10)
+                return false;
+            v = v * 10 + d;
+        }
+        value = v;
+    }
+    return true;
+}
+
+// state of the vectorized scanners between two separators
+typedef struct
+{
+    size_t    start;    // first digit of the current number
+    size_t    n;        // values written
+    bool      dash;     // the current item is a range
+    bool      overflow;
+}scanState;
+
+// number s[state.start..pos) is terminated by the separator at 'pos'; returns false on format errors
+static inline bool endNumber (const char* s, size_t pos, bool isDash, bool ranges, uint64_t* out, scanState& state)
+{
+    if (pos == state.start || (isDash && state.dash))
+        return false;
+    uint64_t v = 0;
+    if (!convertRun (s + state.start, pos - state.start, pos, v))
+        state.overflow = true;
+    out[state.n++] = v;
+    if (ranges && !isDash && !state.dash)
+        out[state.n++] = v;
+    state.dash  = isDash;
+    state.start = pos + 1;
+    return true;
+}
+
+// bytes that don't fill a whole vector and the end of the input
+static inline cmdline_error scanTail (const char* s, size_t i, size_t len, bool ranges, uint64_t* out, size_t& count,
+    scanState& state)
+{
+    for (; i < len; i++)
+    {
+        char c = s[i];
+        if (c >= '0' && c <= '9')
+            continue;
+        if (!(c == ',' || (ranges && c == '-')) || !endNumber (s, i, c == '-', ranges, out, state))
+            return CMDLINE_INVALID_ARGUMENT;
+    }
+    if (!endNumber (s, len, false, ranges, out, state))
+        return CMDLINE_INVALID_ARGUMENT;
+    count = state.n;
+    return state.overflow ? CMDLINE_OUT_OF_RANGE : CMDLINE_OK;
+}
+
+// handles the separators of one vector; returns false on format errors
+static inline bool scanSeparators (const char* s, size_t i, unsigned sep, unsigned dashes, bool ranges, uint64_t* out,
+    scanState& state)
+{
+    while (sep)
+    {
+        unsigned bit = (unsigned)__builtin_ctz (sep);
+        sep &= sep - 1;
+        if (!endNumber (s, i + bit, (dashes >> bit) & 1, ranges, out, state))
+            return false;
+    }
+    return true;
+}
+
+__attribute__ ((target ("sse2")))
+static cmdline_error scanSse2 (const char* s, size_t len, bool ranges, uint64_t* out, size_t& count)
+{
+    const __m128i below = _mm_set1_epi8 ('0' - 1);
+    const __m128i above = _mm_set1_epi8 ('9' + 1);
+    const __m128i comma = _mm_set1_epi8 (',');
+    const __m128i dash  = _mm_set1_epi8 ('-');
+    scanState state = {0, 0, false, false};
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128 ((const __m128i*)(s + i));
+        unsigned digits = (unsigned)_mm_movemask_epi8 (_mm_and_si128 (_mm_cmpgt_epi8 (v, below), _mm_cmplt_epi8 (v, above)));
+        unsigned commas = (unsigned)_mm_movemask_epi8 (_mm_cmpeq_epi8 (v, comma));
+        unsigned dashes = ranges ? (unsigned)_mm_movemask_epi8 (_mm_cmpeq_epi8 (v, dash)) : 0;
+        if ((digits | commas | dashes) != 0xFFFF)
+            return CMDLINE_INVALID_ARGUMENT;
+        if (!scanSeparators (s, i, commas | dashes, dashes, ranges, out, state))
+            return CMDLINE_INVALID_ARGUMENT;
+    }
+    return scanTail (s, i, len, ranges, out, count, state);
+}
+
+__attribute__ ((target ("avx2")))
+static cmdline_error scanAvx2 (const char* s, size_t len, bool ranges, uint64_t* out, size_t& count)
+{
+    const __m256i below = _mm256_set1_epi8 ('0' - 1);
+    const __m256i above = _mm256_set1_epi8 ('9' + 1);
+    const __m256i comma = _mm256_set1_epi8 (',');
+    const __m256i dash  = _mm256_set1_epi8 ('-');
+    scanState state = {0, 0, false, false};
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256 ((const __m256i*)(s + i));
+        unsigned digits = (unsigned)_mm256_movemask_epi8 (_mm256_and_si256 (_mm256_cmpgt_epi8 (v, below), _mm256_cmpgt_epi8 (above, v)));
+        unsigned commas = (unsigned)_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, comma));
+        unsigned dashes = ranges ? (unsigned)_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, dash)) : 0;
+        if ((digits | commas | dashes) != 0xFFFFFFFFu)
+            return CMDLINE_INVALID_ARGUMENT;
+        if (!scanSeparators (s, i, commas | dashes, dashes, ranges, out, state))
+            return CMDLINE_INVALID_ARGUMENT;
+    }
+    return scanTail (s, i, len, ranges, out, count, state);
+}
+#endif
+
+static cNumberList::implementation detect ()
+{
+#ifdef NUMBERLIST_X86
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+        return cNumberList::AVX2;
+    if (__builtin_cpu_supports ("sse2"))
+        return cNumberList::SSE2;
+#endif
+    return cNumberList::SCALAR;
+}
+
+bool cNumberList::available (implementation impl)
+{
+    static const implementation best = detect ();
+    return impl == BEST || impl <= best;
+}
+
+cmdline_error cNumberList::scan (const char* s, size_t len, bool ranges, uint64_t* out, size_t& count,
+    implementation impl)
+{
+    static const implementation best = detect ();
+    if (impl == BEST || impl > best)
+        impl = best;
+
+    count = 0;
+#ifdef NUMBERLIST_X86
+    if (impl == AVX2)
+        return scanAvx2 (s, len, ranges, out, count);
+    if (impl == SSE2)
+        return scanSse2 (s, len, ranges, out, count);
+#endif
+    return scanScalar (s, len, ranges, out, count);
+}
+
+void cNumberList::setRange (uint64_t* words, uint64_t first, uint64_t last)
+{
+    size_t firstWord = (size_t)(first / 64);
+    size_t lastWord  = (size_t)(last / 64);
+    uint64_t firstMask = ~0ULL << (first % 64);
+    uint64_t lastMask  = ~0ULL >> (63 - last % 64);
+
+    if (firstWord == lastWord)
+    {
+        words[firstWord] |= firstMask & lastMask;
+        return;
+    }
+    words[firstWord] |= firstMask;
+    for (size_t n = firstWord + 1; n < lastWord; n++)
+        words[n] = ~0ULL;
+    words[lastWord] |= lastMask;
+}
+
+
+#ifdef WITH_UNITTESTS
+// every implementation must give the same result as the scalar reference
+static void compareImplementations (const std::string& s, bool ranges)
+{
+    std::vector<uint64_t> expected (cNumberList::capacity (s.size (), ranges));
+    std::vector<uint64_t> values (expected.size ());
+    size_t expectedCount = 0;
+    cmdline_error e = cNumberList::scan (s.data (), s.size (), ranges, expected.data (), expectedCount, cNumberList::SCALAR);
+    BUG_IF_NOT (expectedCount <= expected.size ());
+
+    const cNumberList::implementation impls[] = {cNumberList::SSE2, cNumberList::AVX2, cNumberList::BEST};
+    for (cNumberList::implementation impl : impls)
+    {
+        if (!cNumberList::available (impl))
+            continue;
+        size_t count = 0;
+        BUG_IF_NOT (cNumberList::scan (s.data (), s.size (), ranges, values.data (), count, impl) == e);
+        if (e == CMDLINE_OK)
+        {
+            BUG_IF_NOT (count == expectedCount);
+            BUG_IF_NOT (!memcmp (values.data (), expected.data (), count * sizeof (uint64_t)));
+        }
+    }
+}
+
+void cNumberList::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+    {
+        uint64_t out[32];
+        size_t count = 0;
+        const implementation impls[] = {SCALAR, SSE2, AVX2};
+        for (implementation impl : impls)
+        {
+            const char* s = "17,42,0,007,18446744073709551615,123456789012345678";
+            BUG_IF_NOT (scan (s, strlen (s), false, out, count, impl) == CMDLINE_OK && count == 6);
+            BUG_IF_NOT (out[0] == 17 && out[1] == 42 && out[2] == 0 && out[3] == 7);
+            BUG_IF_NOT (out[4] == UINT64_MAX && out[5] == 123456789012345678ULL);
+
+            s = "0-63,128-191,200";
+            BUG_IF_NOT (scan (s, strlen (s), true, out, count, impl) == CMDLINE_OK && count == 6);
+            BUG_IF_NOT (out[0] == 0 && out[1] == 63 && out[2] == 128 && out[3] == 191 && out[4] == 200 && out[5] == 200);
+
+            s = "1,18446744073709551616,2";
+            BUG_IF_NOT (scan (s, strlen (s), false, out, count, impl) == CMDLINE_OUT_OF_RANGE);
+            s = "1,99999999999999999999999,x";
+            BUG_IF_NOT (scan (s, strlen (s), false, out, count, impl) == CMDLINE_INVALID_ARGUMENT);
+
+            const char* invalid[] = {"", ",", "1,", ",1", "1,,2", "1-2", " 1", "1 ", "+1", "0x1"};
+            for (const char* i : invalid)
+                BUG_IF_NOT (scan (i, strlen (i), false, out, count, impl) == CMDLINE_INVALID_ARGUMENT);
+            const char* invalidRanges[] = {"-", "1-", "-1", "1--2", "1-2-3", "1-2,", "1,-2"};
+            for (const char* i : invalidRanges)
+                BUG_IF_NOT (scan (i, strlen (i), true, out, count, impl) == CMDLINE_INVALID_ARGUMENT);
+        }
+    }
+    {
+        // random lists around the vector sizes, valid and with errors
+        srand (4711);
+        const char alphabet[] = "0123456789,,,--x";
+        for (int n = 0; n < 20000; n++)
+        {
+            std::string s;
+            size_t len = (size_t)(rand () % 100);
+            if (n % 2)
+            {
+                // valid: numbers with 1 to 22 digits
+                while (s.size () < len)
+                {
+                    if (!s.empty ())
+                        s += n % 4 == 1 && rand () % 3 == 0 ? '-' : ',';
+                    int digits = 1 + rand () % (rand () % 8 == 0 ? 22 : 6);
+                    for (int d = 0; d < digits; d++)
+                        s += (char)('0' + rand () % 10);
+                }
+            }
+            else
+            {
+                for (size_t k = 0; k < len; k++)
+                    s += rand () % 4 ? (char)('0' + rand () % 10) : alphabet[rand () % (sizeof (alphabet) - 1)];
+            }
+            compareImplementations (s, false);
+            compareImplementations (s, true);
+        }
+    }
+    {
+        uint64_t words[4] = {0, 0, 0, 0};
+        setRange (words, 3, 3);
+        setRange (words, 60, 130);
+        setRange (words, 192, 255);
+        BUG_IF_NOT (words[0] == ((1ULL << 3) | (0xFULL << 60)) && words[1] == ~0ULL);
+        BUG_IF_NOT (words[2] == 7 && words[3] == ~0ULL);
+    }
+}
+#endif
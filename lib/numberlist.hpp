@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef NUMBERLIST_HPP_
+#define NUMBERLIST_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cmdline.hpp"
+
+// Scanner for long lists of unsigned decimal numbers, like "17,42,4711" or, as range set, "0-63,128-191".
+// On x86 the input is classified 16 (SSE2) or 32 (AVX2) bytes at a time, the best variant is chosen at runtime.
+class cNumberList
+{
+public:
+    typedef enum {SCALAR, SSE2, AVX2, BEST}implementation;
+
+    // range sets only contain values below this limit, it bounds the size of the bitset
+    static const uint64_t RANGE_LIMIT = 1ULL << 24;
+
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    static bool available (implementation impl);
+
+    // number of values 'scan' writes at most for 'len' bytes
+    static size_t capacity (size_t len, bool ranges)
+    {
+        return ranges ? len + 1 : len / 2 + 1;
+    }
+
+    // Splits 'len' bytes at 's' into numbers separated by ','. With 'ranges', an item can also be a range "first-last"
+    // and every item is written as pair first, last. 'out' must hold capacity (len, ranges) values.
+    // Returns CMDLINE_OK, CMDLINE_INVALID_ARGUMENT (format errors take precedence) or CMDLINE_OUT_OF_RANGE.
+    static cmdline_error scan (const char* s, size_t len, bool ranges, uint64_t* out, size_t& count,
+        implementation impl = BEST);
+
+    // sets the bits first..last in 'words'
+    static void setRange (uint64_t* words, uint64_t first, uint64_t last);
+};
+
+#endif /* NUMBERLIST_HPP_ */
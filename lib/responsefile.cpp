@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+#ifndef HAVE_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "responsefile.hpp"
+#include "bug.hpp"
+#include "console.hpp"
+
+
+cResponseFile::cResponseFile ()
+{
+    text   = NULL;
+    size   = 0;
+    mapped = 0;
+}
+
+cResponseFile::cResponseFile (cResponseFile&& other) noexcept
+{
+    text   = other.text;
+    size   = other.size;
+    mapped = other.mapped;
+    other.text   = NULL;
+    other.size   = 0;
+    other.mapped = 0;
+}
+
+cResponseFile::~cResponseFile ()
+{
+    close ();
+}
+
+bool cResponseFile::open (const char* path)
+{
+    close ();
+#ifdef HAVE_WINDOWS
+    // no mmap, just read it
+    FILE* f = fopen (path, "rb");
+    if (!f)
+        return false;
+    long len;
+    if (fseek (f, 0, SEEK_END) || (len = ftell (f)) < 0 || fseek (f, 0, SEEK_SET))
+    {
+        fclose (f);
+        return false;
+    }
+    size = (size_t)len;
+    text = new (std::nothrow) char[size + 1];
+    if (!text || fread (text, 1, size, f) != size)
+    {
+        fclose (f);
+        close ();
+        return false;
+    }
+    text[size] = '\0';
+    fclose (f);
+#else
+    int fd = ::open (path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat (fd, &st) || !S_ISREG (st.st_mode))
+    {
+        ::close (fd);
+        return false;
+    }
+    size = (size_t)st.st_size;
+
+    // The arguments are split in place, the last one needs a terminating '\0' behind the end of the file.
+    // The rest of the last page of a mapping is zero-filled, but if the file ends on a page boundary there
+    // is no such rest. Therefore we reserve a zero-filled anonymous region with one byte more and map the
+    // file over it. The mapping is private, the file itself is never modified.
+    size_t page = (size_t)sysconf (_SC_PAGESIZE);
+    mapped = (size + 1 + page - 1) / page * page;
+    void* p = mmap (NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        ::close (fd);
+        mapped = 0;
+        return false;
+    }
+    text = static_cast<char*>(p);
+    if (size && mmap (p, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        ::close (fd);
+        close ();
+        return false;
+    }
+    ::close (fd);
+    madvise (p, mapped, MADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+void cResponseFile::close ()
+{
+#ifdef HAVE_WINDOWS
+    delete[] text;
+#else
+    if (text)
+        munmap (text, mapped);
+#endif
+    text   = NULL;
+    size   = 0;
+    mapped = 0;
+}
+
+char* cResponseFile::next (char*& pos)
+{
+    BUG_ON (!text);
+    return nextArg (pos, text + size);
+}
+
+char* cResponseFile::nextArg (char*& pos, char* end)
+{
+    char* in = pos;
+    while (in < end && (*in == ' ' || (*in >= '\t' && *in <= '\r')))
+        in++;
+    if (in >= end)
+    {
+        pos = end;
+        return NULL;
+    }
+
+    // unquoting never makes an argument longer, so it's written to the same place
+    char* arg = in;
+    char* out = in;
+    char quote = '\0';
+    for (; in < end; in++)
+    {
+        char c = *in;
+        if (quote == '\'')
+        {
+            if (c == '\'')
+                quote = '\0';
+            else
+                *out++ = c;
+        }
+        else if (c == '\\' && in + 1 < end)
+        {
+            *out++ = *++in;
+        }
+        else if (quote == '"')
+        {
+            if (c == '"')
+                quote = '\0';
+            else
+                *out++ = c;
+        }
+        else if (c == '\'' || c == '"')
+        {
+            quote = c;
+        }
+        else if (c == ' ' || (c >= '\t' && c <= '\r'))
+        {
+            break;
+        }
+        else
+        {
+            *out++ = c;
+        }
+    }
+    // 'in' is either the separator or end, 'out' <= 'in'
+    pos = in < end ? in + 1 : end;
+    *out = '\0';
+    return arg;
+}
+
+
+#ifdef WITH_UNITTESTS
+void cResponseFile::unitTest ()
+{
+    Console::PrintDebug("-- " __FILE__ " --\n");
+
+    {
+        char text[] = "  -a AAA\t--argb=\"B B\"\n'C \\ \"C\"' D\\ D \"E\\\"E\" '' \"\" F'G'\"H\"\r\nlast";
+        const char* expected[] = {"-a", "AAA", "--argb=B B", "C \\ \"C\"", "D D", "E\"E", "", "", "FGH", "last", NULL};
+        char* pos = text;
+        char* arg;
+        int n = 0;
+
+        while ((arg = nextArg (pos, text + sizeof (text) - 1)) != NULL)
+        {
+            BUG_IF_NOT (expected[n]);
+            BUG_IF_NOT (!strcmp (arg, expected[n]));
+            n++;
+        }
+        BUG_IF_NOT (!expected[n]);
+    }
+    {
+        char text[] = " \n\t ";
+        char* pos = text;
+        BUG_IF_NOT (!nextArg (pos, text + sizeof (text) - 1));
+    }
+#ifndef HAVE_WINDOWS
+    {
+        // a file that ends exactly on a page boundary, without trailing whitespace
+        char path[] = "/tmp/cmdline-unittest-XXXXXX";
+        int fd = mkstemp (path);
+        BUG_IF_NOT (fd >= 0);
+        size_t page = (size_t)sysconf (_SC_PAGESIZE);
+        char* content = new char[page];
+        memset (content, 'x', page);
+        memcpy (content, "-a 'A A' ", 9);
+        BUG_IF_NOT (write (fd, content, page) == (ssize_t)page);
+        ::close (fd);
+        delete[] content;
+
+        cResponseFile file;
+        BUG_IF_NOT (file.open (path));
+        char* pos = file.begin ();
+        BUG_IF_NOT (!strcmp (file.next (pos), "-a"));
+        BUG_IF_NOT (!strcmp (file.next (pos), "A A"));
+        char* last = file.next (pos);
+        BUG_IF_NOT (last && strlen (last) == page - 9);
+        BUG_IF_NOT (!file.next (pos));
+        unlink (path);
+
+        BUG_IF_NOT (!file.open ("/nonexistent/cmdline-unittest"));
+    }
+#endif
+}
+#endif
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RESPONSEFILE_HPP_
+#define RESPONSEFILE_HPP_
+
+#include <cstddef>
+
+// A response file (@file) mapped into memory. The arguments are split in place, i.e. they point directly into
+// the mapping and stay valid until the file is closed.
+// Arguments are separated by whitespace. Within single quotes everything is taken literally, within double quotes
+// and outside of quotes a backslash escapes the next character.
+class cResponseFile
+{
+public:
+    cResponseFile ();
+    cResponseFile (cResponseFile&& other) noexcept;
+    ~cResponseFile ();
+    cResponseFile (const cResponseFile&) = delete;
+    cResponseFile& operator= (const cResponseFile&) = delete;
+
+#ifdef WITH_UNITTESTS
+    static void unitTest ();
+#endif
+
+    bool open (const char* path);
+    void close ();
+
+    // returns the next argument or NULL if there are no more; 'pos' must be initialized with begin ()
+    char* next (char*& pos);
+    char* begin ()
+    {
+        return text;
+    }
+    char* end ()
+    {
+        return text + size;
+    }
+
+    // splits 'len' bytes of 'text' in place, text[len] must be writable and '\0'
+    static char* nextArg (char*& pos, char* end);
+
+private:
+    char*  text;
+    size_t size;
+    size_t mapped;
+};
+
+#endif /* RESPONSEFILE_HPP_ */
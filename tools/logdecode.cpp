@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * LIBCMDLINE <https://github.com/amartin755/libcmdline>
+ * Copyright (C) 2012-2021 Andreas Martin (netnag@mailbox.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "binarylog.hpp"
+#include "cmdlineapp.hpp"
+#include "consolesink.hpp"
+#include "responsefile.hpp"
+
+class cLogDecode : public cCmdlineApp
+{
+public:
+    cLogDecode ()
+    : cCmdlineApp ("cmdline-logdecode", "Converts binary logs to text", "cmdline-logdecode FILE...",
+        "Writes the messages of binary logs (see CONSOLE_LOG in binarylog.hpp) to stdout, ordered by time. "
+        "Each line starts with the seconds since the log was opened and the number of the thread.", "V1.0")
+    {
+    }
+
+    int execute (const std::vector<std::string>& args) override
+    {
+        if (args.empty ())
+        {
+            Console::PrintError ("No log file given.\n");
+            return -1;
+        }
+
+        cFdSink out;
+        if (!out.attach (1))
+        {
+            Console::PrintError ("Not enough memory\n");
+            return -1;
+        }
+        for (const auto& path : args)
+        {
+            cResponseFile file;
+            if (!file.open (path.c_str ()))
+            {
+                Console::PrintError ("Cannot read `%s'.\n", path.c_str ());
+                return -1;
+            }
+            if (!cBinaryLog::decode (file.begin (), (size_t)(file.end () - file.begin ()), out))
+            {
+                Console::PrintError ("`%s' is not a binary log or it is damaged.\n", path.c_str ());
+                return -1;
+            }
+        }
+        return 0;
+    }
+};
+
+int main (int argc, char* argv[])
+{
+    cLogDecode app;
+    return app.main (argc, argv);
+}
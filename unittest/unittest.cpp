@@ -17,11 +17,327 @@
  */
 
 
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#ifndef HAVE_WINDOWS
+#include <unistd.h>
+#endif
 
 #include "bug.hpp"
 #include "console.hpp"
+#include "argconvert.hpp"
+#include "argsource.hpp"
+#include "binarylog.hpp"
 #include "cmdline.hpp"
+#include "cmdlineapp.hpp"
+#include "cmdlinebatch.hpp"
+#if __cplusplus >= 201703L
+#include "cmdlineschema.hpp"
+#endif
+#include "consoleformat.hpp"
+#include "consolelimit.hpp"
+#include "consolering.hpp"
+#include "consolesink.hpp"
+#include "numberlist.hpp"
+#include "responsefile.hpp"
+
+
+// test hook: counts all allocations from the global heap
+static std::atomic<unsigned long> allocations (0);
+
+void* operator new (std::size_t size)
+{
+    allocations++;
+    void* p = std::malloc (size ? size : 1);
+    if (!p)
+        throw std::bad_alloc ();
+    return p;
+}
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept
+{
+    allocations++;
+    return std::malloc (size ? size : 1);
+}
+void* operator new[] (std::size_t size)
+{
+    return operator new (size);
+}
+void* operator new[] (std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new (size, tag);
+}
+void operator delete (void* p) noexcept
+{
+    std::free (p);
+}
+void operator delete (void* p, const std::nothrow_t&) noexcept
+{
+    std::free (p);
+}
+void operator delete[] (void* p) noexcept
+{
+    std::free (p);
+}
+void operator delete[] (void* p, const std::nothrow_t&) noexcept
+{
+    std::free (p);
+}
+#if __cplusplus >= 201402L
+void operator delete (void* p, std::size_t) noexcept
+{
+    std::free (p);
+}
+void operator delete[] (void* p, std::size_t) noexcept
+{
+    std::free (p);
+}
+#endif
+
+
+// cCmdline with an arena must not touch the global heap
+static void arenaTest ()
+{
+    static char buffer[16 * 1024];
+    unsigned long before = allocations;
+    {
+        const char* argv[] = {"arenatest", "ABCD", "-aAAA", "--argb", "EFGH", "-c", "CCC", "--", "-d"};
+        const char* stringarg1 = NULL;
+        const char* stringarg2 = NULL;
+        int isset1 = -1, isset2 = -1, isset3 = -1, isset4 = -1;
+        int index = 0;
+
+        cArena arena (buffer, sizeof (buffer));
+        cCmdline obj (arena);
+
+        BUG_IF_NOT (obj.reserve (4));
+        BUG_IF_NOT (obj.addOption (false, 'a', "arga", "mandatory option with args", &isset1, "ARG", ARG_STRING, &stringarg1));
+        BUG_IF_NOT (obj.addOption (false, 'b', "argb", "mandatory option without args (makes no sense)", &isset2));
+        BUG_IF_NOT (obj.addOption (true, 'c', "argc", "optional option with args", &isset3, "ARG", ARG_STRING, &stringarg2));
+        BUG_IF_NOT (obj.addOption (true, 0, "argd", "optional long-only option without args", &isset4));
+
+        for (int n = 0; n < 2; n++)
+        {
+            BUG_IF_NOT (obj.parse (9, (char**)argv, &index));
+            BUG_IF_NOT (isset1 == 1 && isset2 == 1 && isset3 == 1 && isset4 == 0);
+            BUG_IF_NOT (!strcmp ("AAA", stringarg1));
+            BUG_IF_NOT (!strcmp ("CCC", stringarg2));
+            BUG_IF_NOT (index == 6);
+        }
+        BUG_IF_NOT (arena.used () > 0);
+    }
+    BUG_IF_NOT (allocations == before);
+
+    // an exhausted arena is reported, not fatal
+    {
+        static char small[1200];
+        const char* argv[] = {"arenatest", "-a"};
+        int isset[26];
+        int n = 0;
+
+        cArena arena (small, sizeof (small));
+        cCmdline obj (arena);
+
+        while (n < 26 && obj.addOption (true, (char)('a' + n), nullptr, "optional short-only option", &isset[n]))
+            n++;
+        BUG_IF_NOT (n < 26);
+        obj.parse (2, (char**)argv); // either works or reports "Not enough memory"
+        BUG_IF_NOT (arena.used () <= arena.capacity ());
+    }
+}
+
+
+#if __cplusplus >= 201703L
+// cStaticCmdline never touches the global heap, arguments beyond its bound are an error
+static void staticCmdlineTest ()
+{
+    static constexpr optionSpec specs[] = {
+        {true, 'a', "arga", "optional option with args", "ARG", ARG_STRING},
+        {true, 'v', nullptr, "optional short-only option without args"},
+    };
+    typedef cStaticCmdline<specs, 4> cmdline;
+    cmdline::result r;
+    const char* argv[] = {"statictest", "ABCD", "-aAAA", "EFGH", "-v", "IJKL"};
+    int index = 0;
+
+    unsigned long before = allocations;
+    BUG_IF_NOT (cmdline::parse (5, (char**)argv, r, &index));
+    BUG_IF_NOT (allocations == before);
+    BUG_IF_NOT (index == 3 && !strcmp (argv[3], "ABCD") && !strcmp (argv[4], "EFGH"));
+    BUG_IF_NOT (!strcmp (r.strArg[cmdline::indexOf ('a')], "AAA") && r.isSet[cmdline::indexOf ('v')] == 1);
+
+    BUG_IF_NOT (!cmdline::parse (6, (char**)argv, r, &index));
+    BUG_IF_NOT (index == 1 && !strcmp (argv[5], "IJKL"));
+}
+#endif
+
+
+// list options don't allocate per value once the result is warmed up
+static void listTest ()
+{
+    const int count = 5000;
+    std::vector<char*> argv;
+    argv.push_back ((char*)"listtest");
+    for (int n = 0; n < count; n++)
+    {
+        argv.push_back ((char*)"-I");
+        argv.push_back ((char*)(n & 1 ? "dir" : "a,b,c"));
+    }
+
+    cCmdline obj;
+    BUG_IF_NOT (obj.addOption (true, 'I', "include", "include", nullptr, "DIR", ARG_STRING_LIST, nullptr));
+    BUG_IF_NOT (obj.addOption (true, 't', "tag", "tags", nullptr, "TAG,...", ARG_STRING_CSV, nullptr));
+    cCmdlineResult r;
+    BUG_IF_NOT (obj.parse ((int)argv.size (), argv.data (), r));
+
+    unsigned long before = allocations;
+    BUG_IF_NOT (obj.parse ((int)argv.size (), argv.data (), r));
+    BUG_IF_NOT (allocations == before);
+    BUG_IF_NOT (r.getList (0).count == count);
+
+    // splitting needs more items, they are allocated at once
+    for (int n = 0; n < count; n++)
+        argv[n * 2 + 1] = (char*)"-t";
+    before = allocations;
+    BUG_IF_NOT (obj.parse ((int)argv.size (), argv.data (), r));
+    BUG_IF_NOT (allocations <= before + 1);
+    BUG_IF_NOT (r.getList (1).count == count / 2 * 4);
+}
+
+
+// subcommands: only the selected one adds its options
+class cSubcommandApp : public cCmdlineApp
+{
+public:
+    cSubcommandApp ()
+    : cCmdlineApp ("subtest", "subcommand test", "subtest [OPTIONS] COMMAND ...", "description", "1.0")
+    {
+        static const char* names[] = {"one", "two", "three"};
+
+        global = 0;
+        extra = 0;
+        ran = -1;
+        for (int n = 0; n < 3; n++)
+        {
+            built[n] = 0;
+            BUG_IF_NOT (addSubcommand (names[n], "a command", "subtest COMMAND [OPTIONS]",
+                [this, n](cCmdline& cmdline)
+                {
+                    built[n]++;
+                    cmdline.addOption (true, 'x', "extra", "extra option", nullptr, "N", ARG_INT, &extra);
+                },
+                [this, n](cArgSource& source)
+                {
+                    const char* arg;
+                    size_t len;
+                    ran = n;
+                    args.clear ();
+                    while ((arg = source.next (&len)) != NULL)
+                        args.emplace_back (arg, len);
+                    return 0;
+                }));
+        }
+        addCmdLineOption (true, 'g', "global", "global option", &global);
+    }
+
+    // main runs a subcommand or fails with "Command missing"
+    int execute (const std::vector<std::string>& args) override
+    {
+        (void)args;
+        BUG ("not reached");
+        return -1;
+    }
+
+    int global;
+    int extra;
+    int ran;
+    int built[3];
+    std::vector<std::string> args;
+};
+
+static void subcommandTest ()
+{
+    cSubcommandApp app;
+    BUG_IF_NOT (app.built[0] == 0 && app.built[1] == 0 && app.built[2] == 0);
+
+    {
+        const char* argv[] = {"subtest", "-g", "two", "a", "-x", "5", "b", NULL};
+        BUG_IF_NOT (app.main (7, (char**)argv) == 0);
+        BUG_IF_NOT (app.global == 1 && app.extra == 5 && app.ran == 1);
+        BUG_IF_NOT (app.built[0] == 0 && app.built[1] == 1 && app.built[2] == 0);
+        BUG_IF_NOT (app.args.size () == 2 && app.args[0] == "a" && app.args[1] == "b");
+    }
+    {
+        // global options only before the subcommand, options of the subcommand only after it
+        const char* argv[] = {"subtest", "three", "-g", NULL};
+        BUG_IF_NOT (app.main (3, (char**)argv) != 0);
+        const char* argv2[] = {"subtest", "-x", "1", "three", NULL};
+        BUG_IF_NOT (app.main (4, (char**)argv2) != 0);
+        const char* argv3[] = {"subtest", "four", NULL};
+        BUG_IF_NOT (app.main (2, (char**)argv3) != 0);
+        const char* argv4[] = {"subtest", "-g", NULL};
+        BUG_IF_NOT (app.main (2, (char**)argv4) != 0);
+        BUG_IF_NOT (app.built[0] == 0 && app.built[1] == 1 && app.built[2] == 1);
+    }
+
+    cMemorySink memory;
+    char out[4096];
+    Console::SetSink (&memory);
+    {
+        // help of the tool and of a subcommand; -h is shared
+        const char* argv[] = {"subtest", "-h", NULL};
+        BUG_IF_NOT (memory.init (sizeof (out)));
+        BUG_IF_NOT (app.main (2, (char**)argv) == 0);
+        std::string help (out, memory.read (out, sizeof (out)));
+        BUG_IF_NOT (help.find ("Commands:\n one\n") != std::string::npos);
+        BUG_IF_NOT (help.find ("--global") != std::string::npos && help.find ("--extra") == std::string::npos);
+
+        const char* argv2[] = {"subtest", "one", "-h", NULL};
+        BUG_IF_NOT (memory.init (sizeof (out)));
+        BUG_IF_NOT (app.main (3, (char**)argv2) == 0);
+        help.assign (out, memory.read (out, sizeof (out)));
+        BUG_IF_NOT (!help.compare (0, 32, "subtest one - a command\n\nUsage: "));
+        BUG_IF_NOT (help.find ("--extra") != std::string::npos && help.find ("--global") == std::string::npos);
+        BUG_IF_NOT (app.ran == 1);
+    }
+    Console::SetSink (nullptr);
+
+#ifndef HAVE_WINDOWS
+    {
+        // completion of subcommands and of their options, written to stdout
+        auto complete = [&app](std::vector<const char*> words)
+        {
+            int fds[2];
+            BUG_IF_NOT (!pipe (fds));
+            fflush (stdout);
+            int saved = dup (1);
+            BUG_IF_NOT (saved >= 0 && dup2 (fds[1], 1) == 1);
+            words.insert (words.begin (), {"subtest", "--__complete"});
+            words.push_back (NULL);
+            BUG_IF_NOT (app.main ((int)words.size () - 1, (char**)words.data ()) == 0);
+            fflush (stdout);
+            BUG_IF_NOT (dup2 (saved, 1) == 1);
+            close (saved);
+            close (fds[1]);
+            char out[1024];
+            ssize_t len = read (fds[0], out, sizeof (out));
+            close (fds[0]);
+            return std::string (out, len > 0 ? (size_t)len : 0);
+        };
+        BUG_IF_NOT (complete ({"t"}) == "two\nthree\n");
+        BUG_IF_NOT (complete ({"-g", ""}) == "one\ntwo\nthree\n");
+        BUG_IF_NOT (complete ({"--g"}) == "--global\n");
+        BUG_IF_NOT (complete ({"one", "--e"}) == "--extra\n");
+        BUG_IF_NOT (complete ({"-g", "one", "a", "--"}) == "--help\n--verbose\n--extra\n");
+        BUG_IF_NOT (complete ({"one", "-x", ""}) == "");
+        BUG_IF_NOT (complete ({"four", "-"}) == "");
+    }
+#endif
+}
 
 
 int main (void)
@@ -29,7 +345,24 @@ int main (void)
     Console::SetPrintLevel(Console::Debug);
     try
     {
+        cArgConvert::unitTest ();
         cCmdline::unitTest ();
+        cCmdlineBatch::unitTest ();
+        cNumberList::unitTest ();
+        cConsoleRing::unitTest ();
+        cFdSink::unitTest ();
+        cFormatBuffer::unitTest ();
+        Console::unitTest ();
+        cConsoleLimit::unitTest ();
+        cBinaryLog::unitTest ();
+        cResponseFile::unitTest ();
+        cArgSource::unitTest ();
+        arenaTest ();
+#if __cplusplus >= 201703L
+        staticCmdlineTest ();
+#endif
+        listTest ();
+        subcommandTest ();
     }
     catch (...)
     {